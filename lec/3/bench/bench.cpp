@@ -0,0 +1,398 @@
+#include "../src/App.hpp"
+#include "../src/misc/MelFilterBank.hpp"
+#include "../src/misc/fft.hpp"
+#include "../src/plugins/convolve/ConvolveStream.hpp"
+#include "../src/plugins/filter/FilterStream.hpp"
+#include "../src/plugins/mix/MixStream.hpp"
+#include "../src/plugins/mute/MuteStream.hpp"
+#include "../src/plugins/normalize/Loudness.hpp"
+#include "../src/plugins/vocoder/VocoderStream.hpp"
+#include "../src/pointwise.hpp"
+#include "../src/streams/ResampleStream.hpp"
+#include "../src/streams/WavStream.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+// every benchmark reports items/s, an item being one sample of the stage's
+// output (or one input value for the dsp kernels)
+
+const size_t SIGNAL_LENGTH = 1 << 20;
+
+// a few sines and some noise, the same on every call
+static std::shared_ptr<const std::vector<float>> signal(size_t length,
+                                                        std::uint32_t seed) {
+    auto data = std::make_shared<std::vector<float>>(length);
+    std::uint32_t state = seed;
+    for (size_t i = 0; i < length; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        float noise = (float)state / 4294967296.f - 0.5f;
+        float t = (float)i / 44100.f;
+        (*data)[i] = 0.3f * std::sin(2.f * M_PI * 220.f * t) +
+                     0.2f * std::sin(2.f * M_PI * 3135.f * t) + 0.1f * noise;
+    }
+    return data;
+}
+
+// in-memory source of samples, clones share the data
+struct SignalStream : public Stream<float> {
+    SignalStream(std::shared_ptr<const std::vector<float>> data)
+        : data(std::move(data)), pos(0) {
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        if (pos == data->size()) {
+            return std::nullopt;
+        }
+        size_t r = std::min(out.size(), data->size() - pos);
+        std::memcpy(out.data(), data->data() + pos, r * sizeof(float));
+        pos += r;
+        return std::make_optional(r);
+    }
+
+    bool seek(size_t to) override {
+        pos = std::min(to, data->size());
+        return true;
+    }
+
+    std::optional<size_t> length() const override {
+        return std::make_optional(data->size());
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<SignalStream>(*this);
+    }
+
+  private:
+    std::shared_ptr<const std::vector<float>> data;
+    size_t pos;
+};
+
+// in-memory file
+struct BytesStream : public Stream<char> {
+    BytesStream(std::shared_ptr<const std::vector<char>> data)
+        : data(std::move(data)), pos(0) {
+    }
+
+    std::optional<size_t> read(std::span<char> out) override {
+        if (pos == data->size()) {
+            return std::nullopt;
+        }
+        size_t r = std::min(out.size(), data->size() - pos);
+        std::memcpy(out.data(), data->data() + pos, r);
+        pos += r;
+        return std::make_optional(r);
+    }
+
+    StreamBox<char> clone() const override {
+        return box_stream<BytesStream>(*this);
+    }
+
+  private:
+    std::shared_ptr<const std::vector<char>> data;
+    size_t pos;
+};
+
+// discards everything, so only encoding is measured
+struct NullOutputWriter : public OutputWriter {
+    void write(char *data, size_t) override {
+        benchmark::DoNotOptimize(data);
+    }
+};
+
+static StreamBox<float> source(std::uint32_t seed = 1) {
+    static auto a = signal(SIGNAL_LENGTH, 1);
+    static auto b = signal(SIGNAL_LENGTH, 2);
+    return box_stream<SignalStream>(seed == 1 ? a : b);
+}
+
+// reads the whole stream the way write_wav_stream does
+static size_t drain(Stream<float> &stream) {
+    std::vector<float> buffer(44100);
+    size_t total = 0;
+    while (true) {
+        auto r = stream.read_full(buffer);
+        total += r;
+        benchmark::DoNotOptimize(buffer.data());
+        if (r < buffer.size()) {
+            return total;
+        }
+    }
+}
+
+static void BM_WavDecode(benchmark::State &state) {
+    VectorOutputWriter writer;
+    auto input = source();
+    write_wav_stream(writer, input, RenderOptions{},
+                     [](size_t, std::optional<size_t>) {});
+    auto file = std::make_shared<const std::vector<char>>(writer.to_vector());
+
+    size_t samples = 0;
+    for (auto _ : state) {
+        WavStream<BytesStream> wav{BytesStream(file)};
+        samples += drain(wav);
+    }
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_WavDecode);
+
+static void BM_WavEncode(benchmark::State &state) {
+    RenderOptions options;
+    options.dither = state.range(0) != 0;
+
+    size_t samples = 0;
+    for (auto _ : state) {
+        auto input = source();
+        NullOutputWriter writer;
+        samples += write_wav_stream(writer, input, options,
+                                    [](size_t, std::optional<size_t>) {});
+    }
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_WavEncode)->ArgName("dither")->Arg(0)->Arg(1);
+
+// encoding into a temporary file, with ofstream (0) or in the background (1)
+static void BM_WavWrite(benchmark::State &state) {
+    auto path = std::filesystem::temp_directory_path() / "bench_write.wav";
+
+    size_t samples = 0;
+    for (auto _ : state) {
+        auto input = source();
+        std::unique_ptr<OutputWriter> writer;
+        if (state.range(0) == 0) {
+            writer = std::make_unique<FileOutputWriter>(path);
+        } else {
+            writer = std::make_unique<AsyncOutputWriter>(path);
+        }
+        samples += write_wav_stream(*writer, input, RenderOptions{},
+                                    [](size_t, std::optional<size_t>) {});
+    }
+    std::filesystem::remove(path);
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_WavWrite)->ArgName("async")->Arg(0)->Arg(1)->UseRealTime();
+
+// argument is the number of inputs besides the main track
+static void BM_Mix(benchmark::State &state) {
+    size_t samples = 0;
+    for (auto _ : state) {
+        std::vector<MixInput<StreamBox<float>>> inputs;
+        for (size_t i = 0; i < (size_t)state.range(0); i++) {
+            inputs.push_back(MixInput<StreamBox<float>>{
+                .stream = source(2), .insert_at = i * 4410, .gain = 0.8f});
+        }
+        MixBusStream<StreamBox<float>, StreamBox<float>> mix(source(1),
+                                                             std::move(inputs));
+        samples += drain(mix);
+    }
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_Mix)->ArgName("inputs")->Arg(1)->Arg(8)->Arg(50);
+
+// argument is the length of the fades around the range in ms
+static void BM_Mute(benchmark::State &state) {
+    Fade fade{.length = (size_t)state.range(0) * 441 / 10,
+              .shape = FadeShape::cosine};
+
+    // clones share the fade ramps, so only the muting is measured
+    MuteStream<StreamBox<float>> mute(source(), {MuteRange{.start = 44100,
+                                                           .end = 5 * 44100,
+                                                           .before = fade,
+                                                           .after = fade}});
+
+    size_t samples = 0;
+    for (auto _ : state) {
+        auto stream = mute.clone();
+        samples += drain(stream);
+    }
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_Mute)->ArgName("fade")->Arg(0)->Arg(500);
+
+// mix, mute and gain fused into one node, as the app builds them
+// argument is the number of sections in the cascade
+static void BM_Filter(benchmark::State &state) {
+    std::vector<Biquad> sections;
+    for (size_t i = 0; i < (size_t)state.range(0); i++) {
+        sections.push_back(Biquad::peak(100. * (i + 1), 3., 1.));
+    }
+
+    size_t samples = 0;
+    for (auto _ : state) {
+        FilterStream<StreamBox<float>> filter(source(1), sections);
+        samples += drain(filter);
+    }
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_Filter)->ArgName("sections")->Arg(1)->Arg(4)->Arg(8);
+
+static void BM_Pointwise(benchmark::State &state) {
+    size_t samples = 0;
+    for (auto _ : state) {
+        auto node = source(1);
+        fuse(node, MixBusKernel<StreamBox<float>>(
+                       {MixInput<StreamBox<float>>{.stream = source(2),
+                                                   .insert_at = 44100}}));
+        fuse(node,
+             MuteKernel({MuteRange{.start = 44100, .end = 5 * 44100}}));
+        fuse(node, GainKernel{.gain = 0.5f});
+        samples += drain(node);
+    }
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_Pointwise);
+
+// up and down are the ratio of output to input samples
+static void BM_Resample(benchmark::State &state) {
+    size_t up = state.range(0);
+    size_t down = state.range(1);
+
+    size_t samples = 0;
+    for (auto _ : state) {
+        ResampleStream<StreamBox<float>> resample(source(), up, down);
+        samples += drain(resample);
+    }
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_Resample)
+    ->ArgNames({"up", "down"})
+    ->Args({2, 1})
+    ->Args({1, 2})
+    ->Args({137, 100})
+    ->Args({147, 160});
+
+static void BM_Fft(benchmark::State &state) {
+    size_t n = state.range(0);
+    std::vector<std::complex<float>> data(n);
+    auto input = signal(n, 3);
+    for (size_t i = 0; i < n; i++) {
+        data[i] = (*input)[i];
+    }
+
+    auto plan = FftPlan::get(n);
+    for (auto _ : state) {
+        plan->execute(data, false);
+        plan->execute(data, true);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n * 2);
+}
+BENCHMARK(BM_Fft)->RangeMultiplier(2)->Range(256, 8192);
+
+static void BM_RealFft(benchmark::State &state) {
+    size_t n = state.range(0);
+    auto plan = RealFftPlan::get(n);
+    std::vector<std::complex<float>> data(n / 2 + 1);
+    auto input = signal(n, 3);
+    auto samples = RealFftPlan::samples(data);
+    std::copy(input->begin(), input->begin() + n, samples.begin());
+
+    for (auto _ : state) {
+        plan->forward(data);
+        plan->inverse(data);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n * 2);
+}
+BENCHMARK(BM_RealFft)->RangeMultiplier(2)->Range(256, 8192);
+
+static void BM_MelApply(benchmark::State &state) {
+    size_t window = 2048;
+    MelFilterBank bank(window / 2, 0., window / 2., window, 40);
+    auto spectrum = signal(window / 2, 4);
+    std::vector<float> input(spectrum->begin(), spectrum->end());
+    std::vector<float> bands(40);
+
+    for (auto _ : state) {
+        bank.apply(input, bands);
+        benchmark::DoNotOptimize(bands.data());
+    }
+    state.SetItemsProcessed(state.iterations() * input.size());
+}
+BENCHMARK(BM_MelApply);
+
+static void BM_MelReconstruct(benchmark::State &state) {
+    size_t window = 2048;
+    MelFilterBank bank(window / 2, 0., window / 2., window, 40);
+    auto values = signal(40, 5);
+    std::vector<float> bands(values->begin(), values->end());
+    std::vector<float> output(window / 2);
+
+    for (auto _ : state) {
+        bank.reconstruct(bands, output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(state.iterations() * output.size());
+}
+BENCHMARK(BM_MelReconstruct);
+
+// argument is the length of the impulse response in seconds
+static void BM_Convolve(benchmark::State &state) {
+    auto response = signal(state.range(0) * 44100, 2);
+
+    size_t samples = 0;
+    for (auto _ : state) {
+        ConvolveStream<StreamBox<float>, StreamBox<float>> convolve(
+            source(1), box_stream<SignalStream>(response), 1024);
+        samples += drain(convolve);
+    }
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_Convolve)->ArgName("seconds")->Arg(1)->Arg(5);
+
+// vocoder of `a` with the carrier `b` on a SpectralStream of its own
+static StreamBox<float> vocoder_stream(StreamBox<float> &&a,
+                                       StreamBox<float> &&b,
+                                       std::shared_ptr<ThreadPool> pool) {
+    auto stream =
+        box_stream<SpectralStream>(std::move(a), 2048, 1024, std::move(pool));
+    auto spectral = stream.as<SpectralStream>();
+    auto carrier = spectral->add_input(std::move(b));
+    spectral->push(std::make_shared<VocoderProcessor>(carrier, 2048, 40));
+    return stream;
+}
+
+// argument is the number of pool threads, 0 runs without a pool
+static void BM_Vocoder(benchmark::State &state) {
+    std::shared_ptr<ThreadPool> pool;
+    if (state.range(0) != 0) {
+        pool = std::make_shared<ThreadPool>(state.range(0));
+    }
+
+    size_t samples = 0;
+    for (auto _ : state) {
+        auto vocoder = vocoder_stream(source(1), source(2), pool);
+        samples += drain(vocoder);
+    }
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_Vocoder)->ArgName("threads")->Arg(0)->Arg(3)->UseRealTime();
+
+// argument is the number of pool threads, 0 scans sequentially
+static void BM_Loudness(benchmark::State &state) {
+    std::shared_ptr<ThreadPool> pool;
+    if (state.range(0) != 0) {
+        pool = std::make_shared<ThreadPool>(state.range(0));
+    }
+
+    size_t samples = 0;
+    for (auto _ : state) {
+        auto node = source(1);
+        auto loudness = measure_loudness(node, pool.get(), false);
+        benchmark::DoNotOptimize(loudness);
+        samples += *node.length();
+    }
+    state.SetItemsProcessed(samples);
+}
+BENCHMARK(BM_Loudness)->ArgName("threads")->Arg(0)->Arg(3)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -2,14 +2,31 @@
 #define APP_APP_H
 
 #include "config/Context.hpp"
+#include "misc/AsyncOutputWriter.hpp"
 #include "misc/OutputWriter.hpp"
+#include "misc/Stats.hpp"
+#include "misc/Trace.hpp"
+#include "misc/ThreadPool.hpp"
+#include "misc/convert.hpp"
+#include "streams/FdStream.hpp"
 #include "streams/FileStream.hpp"
+#include "streams/MmapFileStream.hpp"
+#include "streams/MmapWavStream.hpp"
+#include "streams/PipeStream.hpp"
+#include "streams/RangeStream.hpp"
+#include "streams/ResampleStream.hpp"
+#include "streams/SilenceStream.hpp"
 #include "streams/Stream.hpp"
+#include "streams/TeeStream.hpp"
 #include "streams/WavStream.hpp"
 
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <sched.h>
 #include <span>
@@ -18,28 +35,117 @@
 #include <unordered_map>
 #include <vector>
 
+// reference to a slot in the config, checked when the step is applied
+struct SlotRef {
+    size_t id;
+    PositionRange where;
+};
+
+static SlotRef read_slot_ref(Context &ctx) {
+    auto start = ctx.position;
+    auto slot_id = read_slot_id(ctx);
+    auto end = ctx.position;
+    if (slot_id == 0) {
+        throw ConfigError(start, end, "slot ids start from 1");
+    }
+    return SlotRef{.id = slot_id, .where = PositionRange(start, end)};
+}
+
 struct State {
-    Context &ctx;
     std::vector<StreamBox<float>> slots;
 
-    size_t read_slot() {
-        auto start = ctx.position;
-        auto slot_id = read_slot_id(ctx);
-        auto end = ctx.position;
-        if (slot_id == 0) {
-            throw ConfigError(start, end, "slot ids start from 1");
-        } else if (slot_id > slots.size()) {
-            throw ConfigError(start, end,
-                              format("slot ", slot_id, " is empty"));
+    // workers for commands that can split their work, null when rendering
+    // on a single thread
+    std::shared_ptr<ThreadPool> pool;
+
+    // input files and the text of the steps applied so far, which together
+    // describe what the main slot holds
+    std::vector<std::string> inputs;
+    std::string history;
+
+    // whether measurements may be kept in files between runs
+    bool disk_cache = true;
+
+    StreamBox<float> &slot(const SlotRef &ref) {
+        if (ref.id > slots.size()) {
+            throw ConfigError(ref.where, format("slot ", ref.id, " is empty"));
+        }
+        return slots[ref.id - 1];
+    }
+
+    // new reader of the slot. the slot is turned into a TeeStream the first
+    // time, so all readers share one computation of it instead of cloning
+    // the whole subgraph.
+    StreamBox<float> share(const SlotRef &ref) {
+        auto &s = slot(ref);
+        if (s.as<TeeStream>() == nullptr) {
+            s = box_stream<TeeStream>(std::move(s));
         }
-        return slot_id;
+        return s.clone();
+    }
+};
+
+// parsed command, builds its part of the stream graph. steps don't change
+// when applied, so a parsed config can be rendered many times, also from
+// several threads at once.
+struct Step {
+    virtual void apply(State &state) const = 0;
+
+    // whether the stage is expensive enough to get its own thread when
+    // rendering with -j
+    virtual bool heavy() const {
+        return false;
+    }
+
+    // whether applying the step leaves the track as it is, such steps are
+    // removed from the program
+    virtual bool noop() const {
+        return false;
     }
+
+    // one step doing the work of this step followed by `next`, or null if
+    // they can't be combined without changing the output
+    virtual std::unique_ptr<Step>
+    merge([[maybe_unused]] const Step &next) const {
+        return nullptr;
+    }
+
+    // the command as written in the config, labels its node in stats
+    std::string text;
+
+    virtual ~Step() = default;
 };
 
+using Program = std::vector<std::unique_ptr<Step>>;
+
+// simplifies a parsed program before anything is built from it: adjacent
+// steps are merged where possible and steps that do nothing are dropped.
+// a merged step is labelled with the text of all steps it replaces.
+static Program optimize(Program &&program) {
+    Program result;
+    for (auto &step : program) {
+        if (!result.empty()) {
+            if (auto merged = result.back()->merge(*step); merged) {
+                merged->text = result.back()->text + "; " + step->text;
+                result.back() = std::move(merged);
+                step = nullptr;
+            }
+        }
+        if (step) {
+            result.push_back(std::move(step));
+        }
+        // may make the step before it adjacent to the next one
+        if (result.back()->noop()) {
+            result.pop_back();
+        }
+    }
+    return result;
+}
+
 struct Command {
     virtual std::string name() const = 0;
     virtual std::string help() const = 0;
-    virtual void run(State &state) = 0;
+    virtual std::unique_ptr<Step> parse(Context &ctx) const = 0;
     virtual ~Command() = default;
 };
 
@@ -50,26 +156,53 @@ struct Plugin {
     virtual ~Plugin() = default;
 };
 
+struct RenderOptions {
+    // add TPDF dither when narrowing samples to 16 bits
+    bool dither = false;
+
+    // threads used to render, heavy stages are moved to their own threads
+    // until the limit is reached
+    size_t jobs = 1;
+
+    // part of the result to render, in samples. the graph seeks to the
+    // start where it can instead of rendering everything before it.
+    size_t range_start = 0;
+    std::optional<size_t> range_end;
+
+    // collects per-node counters of the render if set
+    std::shared_ptr<Stats> stats;
+
+    // keep normalize measurements in files under ~/.cache, so later runs
+    // on the same inputs skip the pass over the track
+    bool disk_cache = true;
+};
+
+// returns the number of written samples. sizes in the header are patched
+// at the end if the output is seekable, otherwise they are set to
+// WAV_UNKNOWN_SIZE as streaming encoders do. on_progress gets the number of
+// written samples and the length of the stream, if it's known.
 template <typename P>
-static void write_wav_stream(OutputWriter &output, Stream<float> &stream,
-                             P on_progress) {
+static size_t write_wav_stream(OutputWriter &output, Stream<float> &stream,
+                               const RenderOptions &options, P on_progress) {
+    bool patch = output.seekable();
+
     WavHeader header;
     std::memcpy(header.chunk_id, "RIFF", 4);
-    header.chunk_size = 0;
+    header.chunk_size = patch ? 0 : WAV_UNKNOWN_SIZE;
     std::memcpy(header.format, "WAVE", 4);
     std::memcpy(header.subchunk_1_id, "fmt ", 4);
     header.subchunk_1_size = 16;
     header.audio_format = 1;
     header.num_channels = 1;
-    header.sample_rate = 44100;
-    header.byte_rate = 44100 * 2;
+    header.sample_rate = SAMPLE_RATE;
+    header.byte_rate = SAMPLE_RATE * 2;
     header.block_align = 2;
     header.bits_per_sample = 16;
 
     output.write((char *)&header, sizeof(header));
 
     char id[] = "data";
-    std::uint32_t size = 0;
+    std::uint32_t size = patch ? 0 : WAV_UNKNOWN_SIZE;
 
     output.write(id, 4);
     output.write((char *)&size, 4);
@@ -78,30 +211,114 @@ static void write_wav_stream(OutputWriter &output, Stream<float> &stream,
     std::vector<float> float_buffer(buffer_size);
     std::vector<int16_t> int_buffer(buffer_size);
 
+    TpdfDither dither;
+    std::vector<float> noise_buffer(options.dither ? buffer_size : 0);
+
     size_t progress = 0;
 
     while (1) {
         auto read = stream.read_full(float_buffer);
 
-        for (size_t i = 0; i < read; i++) {
-            int_buffer[i] = float_buffer[i];
+        auto samples = std::span(float_buffer.data(), read);
+        {
+            TraceScope convert_trace("convert", "dsp", "samples", read);
+            if (options.dither) {
+                auto noise = std::span(noise_buffer.data(), read);
+                dither.fill(noise);
+                float_to_int16_dither(samples, noise, int_buffer.data());
+            } else {
+                float_to_int16(samples, int_buffer.data());
+            }
         }
 
-        output.write((char *)int_buffer.data(), read * 2);
+        {
+            TraceScope write_trace("write", "io", "bytes", read * 2);
+            output.write((char *)int_buffer.data(), read * 2);
+        }
 
         progress += read;
 
-        // if (progress > 44100 * 5000) {
-        //     throw std::runtime_error("file too big???");
-        // }
-
-        on_progress((float)progress / (float)*stream.length());
+        on_progress(progress, stream.length());
         if (read < buffer_size) {
             break;
         }
     }
+
+    if (patch) {
+        // sizes that don't fit are left as unknown
+        size_t data_size = progress * 2;
+        std::uint32_t riff_size = WAV_UNKNOWN_SIZE;
+        size = WAV_UNKNOWN_SIZE;
+        if (data_size + sizeof(header) < WAV_UNKNOWN_SIZE) {
+            riff_size = data_size + sizeof(header);
+            size = data_size;
+        }
+
+        output.seek(offsetof(WavHeader, chunk_size));
+        output.write((char *)&riff_size, 4);
+        output.seek(sizeof(header) + 4);
+        output.write((char *)&size, 4);
+        output.seek(sizeof(header) + 8 + data_size);
+    }
+
+    {
+        TraceScope flush_trace("flush", "io");
+        output.flush();
+    }
+
+    return progress;
+}
+
+// converts a decoded file to SAMPLE_RATE if it was recorded at another rate
+template <typename S> static StreamBox<float> to_sample_rate(S &&wav) {
+    auto rate = wav.sample_rate();
+    if (rate == SAMPLE_RATE) {
+        return box_stream<S>(std::move(wav));
+    }
+    return box_stream<ResampleStream<S>>(std::move(wav), SAMPLE_RATE, rate);
+}
+
+// "-" is stdin, regular files are mapped into memory, anything else (pipes,
+// devices) is read through ifstream
+static StreamBox<float> open_input(const std::string &path) {
+    if (path == "-") {
+        return to_sample_rate(WavStream<FdStream>(FdStream(STDIN_FILENO)));
+    } else if (std::filesystem::is_regular_file(path)) {
+        return to_sample_rate(MmapWavStream(MmapFileStream(path)));
+    }
+    return to_sample_rate(WavStream<FileStream>(FileStream(path)));
+}
+
+// "-" is stdout, files are written in the background. existing files that
+// aren't regular (fifos, devices) are written with ofstream, since the
+// writes may not be at an offset there.
+static std::unique_ptr<OutputWriter> open_output(const std::string &path) {
+    if (path == "-") {
+        return std::make_unique<FdOutputWriter>(STDOUT_FILENO);
+    } else if (std::filesystem::exists(path) &&
+               !std::filesystem::is_regular_file(path)) {
+        return std::make_unique<FileOutputWriter>(path);
+    }
+    return std::make_unique<AsyncOutputWriter>(path);
 }
 
+struct BatchJob {
+    std::string out_path;
+    std::vector<std::string> in_paths;
+};
+
+struct BatchFailure {
+    std::string out_path;
+    std::string error;
+};
+
+struct BatchReport {
+    size_t files = 0;
+    size_t samples = 0;
+    double seconds = 0.;
+    std::vector<BatchFailure> failures;
+};
+
 struct App {
     template <typename P> void register_plugin(P plugin) {
         plugin.register_at(*this);
@@ -112,79 +329,221 @@ struct App {
         commands.emplace(cmd.name(), std::move(cmd_ptr));
     }
 
-    StreamBox<float>
-    get_output_stream(const std::string &config,
-                      const std::vector<std::string> &in_paths) {
-        // prepare slots
-        std::vector<StreamBox<float>> _slots;
-
-        for (size_t i = 0; i < in_paths.size(); i++) {
-            auto slot =
-                box_stream<WavStream<FileStream>>(FileStream(in_paths[i]));
-            _slots.push_back(std::move(slot));
-        }
-
-        auto _ctx = Context(config);
-
-        // create execution state
-        State state{.ctx = _ctx, .slots = std::move(_slots)};
+    // reads the config into one step per command, as written
+    Program parse(const std::string &config) const {
+        auto ctx = Context(config);
+        Program program;
 
-        // parse config and run plugins
-        skip_blank(state.ctx);
+        skip_blank(ctx);
 
-        while (*state.ctx != EOF) {
-            auto cmd = read_word(state.ctx, "command");
+        while (*ctx != EOF) {
+            auto start = ctx.position.offset;
+            auto cmd = read_word(ctx, "command");
 
-            if (!commands.contains(cmd)) {
+            auto it = commands.find(cmd);
+            if (it == commands.end()) {
                 throw std::runtime_error(
                     format("unknown command: \"", cmd, "\""));
             }
 
-            skip_idents(state.ctx);
+            skip_idents(ctx);
 
-            commands[cmd]->run(state);
+            program.push_back(it->second->parse(ctx));
 
-            skip_comment(state.ctx);
+            auto &text = program.back()->text;
+            text = config.substr(start, ctx.position.offset - start);
+            text.erase(text.find_last_not_of(" \t\r\n") + 1);
 
-            skip_blank(state.ctx);
+            skip_comment(ctx);
+
+            skip_blank(ctx);
         }
 
-        return std::move(state.slots[0]);
+        return program;
+    }
+
+    Program compile(const std::string &config) const {
+        return optimize(parse(config));
+    }
+
+    StreamBox<float>
+    get_output_stream(const Program &program,
+                      const std::vector<std::string> &in_paths,
+                      const RenderOptions &options = {}) const {
+        if (in_paths.empty()) {
+            throw std::runtime_error("no input files");
+        }
+
+        // create execution state
+        State state;
+        for (auto &path : in_paths) {
+            state.slots.push_back(open_input(path));
+            label(state.slots.back(),
+                  format("input $", state.slots.size()), options);
+        }
+        if (options.jobs > 1) {
+            state.pool = std::make_shared<ThreadPool>(options.jobs - 1);
+        }
+        state.inputs = in_paths;
+        state.disk_cache = options.disk_cache;
+
+        size_t threads = 1;
+
+        // run plugins
+        for (auto &step : program) {
+            step->apply(state);
+            state.history += step->text + "\n";
+            label(state.slots[0], step->text, options);
+
+            if (step->heavy() && threads < options.jobs) {
+                auto s = std::move(state.slots[0]);
+                state.slots[0] = box_stream<PipeStream>(std::move(s));
+                label(state.slots[0], format("(thread of ", step->text, ")"),
+                      options);
+                threads++;
+            }
+        }
+
+        if (options.range_start == 0 && !options.range_end.has_value()) {
+            return std::move(state.slots[0]);
+        }
+        return box_stream<RangeStream<StreamBox<float>>>(
+            std::move(state.slots[0]), options.range_start, options.range_end);
+    }
+
+    StreamBox<float>
+    get_output_stream(const std::string &config,
+                      const std::vector<std::string> &in_paths,
+                      const RenderOptions &options = {}) const {
+        return get_output_stream(compile(config), in_paths, options);
     }
 
     template <typename P>
     void run(const std::string &config, const std::string &out_path,
-             const std::vector<std::string> &in_paths, P on_progress) {
-        auto stream = get_output_stream(config, in_paths);
-        FileOutputWriter writer(out_path);
-        write_wav_stream(writer, stream, on_progress);
+             const std::vector<std::string> &in_paths,
+             const RenderOptions &options, P on_progress) {
+        auto stream = get_output_stream(config, in_paths, options);
+        auto writer = open_output(out_path);
+        write_wav_stream(*writer, stream, options, on_progress);
     }
 
     std::vector<char> run_collect(const std::string &config,
-                                  const std::vector<std::string> &in_paths) {
-        auto stream = get_output_stream(config, in_paths);
+                                  const std::vector<std::string> &in_paths,
+                                  const RenderOptions &options = {}) {
+        auto stream = get_output_stream(config, in_paths, options);
         VectorOutputWriter writer;
-        write_wav_stream(writer, stream, [](float progress) {});
+        write_wav_stream(writer, stream, options,
+                         [](size_t, std::optional<size_t>) {});
         return writer.to_vector();
     }
 
+    // renders every job with the same program on `threads` threads. errors
+    // of single jobs are collected in the report instead of being thrown.
+    template <typename P>
+    BatchReport run_batch(const Program &program,
+                          const std::vector<BatchJob> &jobs, size_t threads,
+                          const RenderOptions &options, P on_progress) const {
+        BatchReport report;
+        std::mutex mutex;
+        size_t done = 0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        // jobs are the unit of parallelism, each one renders on one thread
+        auto job_options = options;
+        job_options.jobs = 1;
+
+        ThreadPool pool(threads - 1);
+        pool.parallel_for(jobs.size(), [&](size_t i, size_t) {
+            auto &job = jobs[i];
+            size_t samples = 0;
+            std::optional<std::string> error;
+
+            try {
+                auto stream =
+                    get_output_stream(program, job.in_paths, job_options);
+                auto writer = open_output(job.out_path);
+                samples = write_wav_stream(
+                    *writer, stream, job_options,
+                    [](size_t, std::optional<size_t>) {});
+            } catch (ConfigException &e) {
+                error = e.describe();
+            } catch (std::exception &e) {
+                error = e.what();
+            }
+
+            std::lock_guard lock(mutex);
+            if (error.has_value()) {
+                report.failures.push_back(BatchFailure{
+                    .out_path = job.out_path, .error = *error});
+            } else {
+                report.files++;
+                report.samples += samples;
+            }
+            done++;
+            on_progress(done, jobs.size());
+        });
+
+        report.seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+        return report;
+    }
+
     std::string help(std::string &bin_name) {
         std::stringstream ss;
 
         ss << "usage: \n";
         ss << "  " << bin_name
-           << " [-h] [-c config.txt output.wav input1.wav [input2.wav...]]\n\n";
+           << " [-h] [--dither] [--no-cache] [-j threads] "
+              "[--range start end] [--stats] [--stats-json path] "
+              "[--trace path] [-c config.txt output.wav input1.wav "
+              "[input2.wav...]]\n";
+        ss << "  " << bin_name
+           << " [-h] [--dither] [--no-cache] [-j threads] "
+              "[--range start end] [--stats] [--stats-json path] "
+              "[--trace path] -c config.txt -b "
+              "manifest.txt\n\n";
 
         ss << "an audio processing program with support of multiple plugins "
               "and commands, "
               "works with WAV PCM files.\n\n";
 
+        ss << "\"-\" can be used as output or input file to write to "
+              "stdout or read from stdin.\n\n";
+
         ss << "example of config file:\n";
         ss << "  # perform multiple operations\n";
         ss << "  mix $2 3 # mix with second track, starting from 3rd second\n";
         ss << "  mute 5 10 # mute from 5th to 10th second\n";
         ss << "  resample 200% # speed up by 2 times";
 
+        ss << "\n\noptions:\n";
+        ss << "  --dither    add TPDF dither when converting to 16 bit\n";
+        ss << "  --no-cache  don't store normalize measurements under "
+              "~/.cache\n";
+        ss << "  --stats     print time spent in every node of the stream "
+              "graph\n";
+        ss << "  --stats-json path\n";
+        ss << "              write the same numbers as JSON to path\n";
+        ss << "  --trace path\n";
+        ss << "              record a timeline of the render in chrome trace "
+              "format\n";
+        ss << "  --range start end\n";
+        ss << "              render only the part between start and end "
+              "seconds\n";
+        ss << "  -j threads  run heavy commands (vocoder, resample) on "
+              "separate threads\n";
+        ss << "              and split vocoder frames and normalize "
+              "analysis between\n";
+        ss << "              threads\n";
+        ss << "  -b manifest render every line of the manifest "
+              "(output.wav input1.wav ...)\n";
+        ss << "              with the same config, -j sets the number of "
+              "files\n";
+        ss << "              rendered at once (all cores by default)";
+
         ss << "\n\navailable commands:\n";
 
         bool first = true;
@@ -202,6 +561,24 @@ struct App {
     }
 
   private:
+    // attaches a probe to the node that was just built, for stats and
+    // trace events. if the step didn't create a node of its own (pointwise
+    // steps fused into the previous one), the node's label is extended
+    // instead.
+    static void label(StreamBox<float> &node, const std::string &text,
+                      const RenderOptions &options) {
+        if (!options.stats && !Trace::enabled()) {
+            return;
+        }
+        if (auto probe = node.probed(); probe != nullptr) {
+            probe->label += "; " + text;
+        } else if (options.stats) {
+            node.attach(options.stats->add(text));
+        } else {
+            node.attach(std::make_shared<Probe>(text));
+        }
+    }
+
     std::unordered_map<std::string, std::unique_ptr<Command>> commands;
 };
 
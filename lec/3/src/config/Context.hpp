@@ -117,6 +117,10 @@ static bool is_eol(char c) {
     return c == '\n' || c == EOF;
 }
 
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
 static void skip_breaks(Context &ctx) {
     while (is_break(*ctx) && *ctx != EOF) {
         ctx++;
@@ -183,6 +187,40 @@ template <typename T> static T read_unsigned(Context &ctx) {
     return result;
 }
 
+// decimal number with an optional sign and fraction, like -3 or 0.5
+template <typename T> static T read_decimal(Context &ctx) {
+    T sign = 1;
+    if (*ctx == '-' || *ctx == '+') {
+        sign = *ctx == '-' ? -1 : 1;
+        ctx++;
+    }
+
+    bool present = false;
+    T result = 0;
+    while (is_digit(*ctx)) {
+        result = result * 10 + (*ctx - '0');
+        ctx++;
+        present = true;
+    }
+
+    if (*ctx == '.') {
+        ctx++;
+        T scale = 1;
+        while (is_digit(*ctx)) {
+            scale /= 10;
+            result += scale * (*ctx - '0');
+            ctx++;
+            present = true;
+        }
+    }
+
+    if (!present) {
+        throw ConfigError(ctx.position, "expected number");
+    }
+
+    return sign * result;
+}
+
 static size_t read_slot_id(Context &ctx) {
     auto at = ctx.position;
     try {
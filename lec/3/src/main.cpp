@@ -5,8 +5,10 @@
 #include "streams/FileStream.hpp"
 #include "streams/Stream.hpp"
 #include "streams/WavStream.hpp"
+#include <chrono>
 #include <exception>
 #include <system_error>
+#include <thread>
 
 #define ESC "\033["
 
@@ -15,12 +17,88 @@ struct AppArgs {
     std::string config;
     std::string out_path;
     std::vector<std::string> in_paths;
+    RenderOptions options;
+
+    // where to write stats as JSON, empty if not needed
+    std::string stats_json_path;
+    bool print_stats = false;
+
+    // where to write the trace, empty if not tracing
+    std::string trace_path;
+
+    // batch mode, used instead of out_path and in_paths
+    std::string batch_path;
+    std::vector<BatchJob> batch;
+    size_t batch_threads = 1;
 };
 
+std::string read_file(const std::string &path) {
+    std::fstream file;
+    file.exceptions(std::ios::failbit);
+    file.open(path);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+// every non-empty line is "output.wav input1.wav [input2.wav...]", lines
+// starting with # are skipped
+std::vector<BatchJob> parse_manifest(const std::string &path) {
+    std::stringstream manifest(read_file(path));
+    std::vector<BatchJob> jobs;
+
+    std::string line;
+    size_t line_nr = 0;
+    while (std::getline(manifest, line)) {
+        line_nr++;
+
+        std::stringstream words(line);
+        std::string word;
+        BatchJob job;
+        while (words >> word) {
+            if (job.out_path == "" && word[0] == '#') {
+                break;
+            } else if (job.out_path == "") {
+                job.out_path = word;
+            } else {
+                job.in_paths.push_back(word);
+            }
+        }
+
+        if (job.out_path == "") {
+            continue;
+        } else if (job.in_paths.empty()) {
+            throw std::runtime_error(
+                format(path, ":", line_nr, ": no input files for \"",
+                       job.out_path, "\""));
+        }
+        jobs.push_back(std::move(job));
+    }
+
+    return jobs;
+}
+
+// non-negative number of seconds, converted to samples
+size_t parse_seconds(const char *arg) {
+    char *end;
+    double seconds = std::strtod(arg, &end);
+    if (*end != '\0' || end == arg || !(seconds >= 0.)) {
+        throw std::runtime_error(format("invalid number of seconds: \"", arg,
+                                        "\""));
+    }
+    return (size_t)(seconds * SAMPLE_RATE);
+}
+
 AppArgs parse_args(App &app, std::span<char *> argv) {
     std::string config_path;
     std::string out_path;
     std::vector<std::string> in_paths;
+    std::string batch_path;
+    std::string stats_json_path;
+    std::string trace_path;
+    RenderOptions options;
+    bool jobs_set = false;
+    bool print_stats = false;
 
     size_t arg = 1;
     while (arg < argv.size()) {
@@ -28,6 +106,57 @@ AppArgs parse_args(App &app, std::span<char *> argv) {
             std::string bin_name = argv[0];
             std::cout << app.help(bin_name) << std::endl;
             exit(0);
+        } else if (!strcmp(argv[arg], "--dither")) {
+            options.dither = true;
+        } else if (!strcmp(argv[arg], "--no-cache")) {
+            options.disk_cache = false;
+        } else if (!strcmp(argv[arg], "-j")) {
+            arg++;
+            if (arg == argv.size()) {
+                throw std::runtime_error("expected number of threads after -j");
+            }
+            char *end;
+            options.jobs = std::strtoul(argv[arg], &end, 10);
+            if (*end != '\0' || options.jobs == 0) {
+                throw std::runtime_error(
+                    format("invalid number of threads: \"", argv[arg], "\""));
+            }
+            jobs_set = true;
+        } else if (!strcmp(argv[arg], "--stats")) {
+            print_stats = true;
+        } else if (!strcmp(argv[arg], "--stats-json")) {
+            arg++;
+            if (arg == argv.size()) {
+                throw std::runtime_error("expected path after --stats-json");
+            }
+            stats_json_path = argv[arg];
+        } else if (!strcmp(argv[arg], "--trace")) {
+            arg++;
+            if (arg == argv.size()) {
+                throw std::runtime_error("expected path after --trace");
+            }
+            trace_path = argv[arg];
+        } else if (!strcmp(argv[arg], "--range")) {
+            if (arg + 2 >= argv.size()) {
+                throw std::runtime_error(
+                    "expected start and end seconds after --range");
+            }
+            auto start = parse_seconds(argv[arg + 1]);
+            auto end = parse_seconds(argv[arg + 2]);
+            if (end <= start) {
+                throw std::runtime_error("range end must be after its start");
+            }
+            options.range_start = start;
+            options.range_end = end;
+            arg += 2;
+        } else if (!strcmp(argv[arg], "-b")) {
+            arg++;
+            if (batch_path != "") {
+                throw std::runtime_error("manifest path was specified twice");
+            } else if (arg == argv.size()) {
+                throw std::runtime_error("expected path to manifest after -b");
+            }
+            batch_path = argv[arg];
         } else if (!strcmp(argv[arg], "-c")) {
             arg++;
             if (config_path != "") {
@@ -46,26 +175,129 @@ AppArgs parse_args(App &app, std::span<char *> argv) {
         arg++;
     }
 
-    if (out_path == "") {
+    if (batch_path != "" && out_path != "") {
+        throw std::runtime_error(
+            "output and input files can't be specified together with -b");
+    } else if (batch_path == "" && out_path == "") {
         throw std::runtime_error("output file was not specified");
     } else if (config_path == "") {
         throw std::runtime_error("config file was not specified");
     }
 
-    // read config
-    std::fstream cfg_file;
-    cfg_file.exceptions(std::ios::failbit);
-    cfg_file.open(config_path);
-    std::stringstream cfg_buffer;
-    cfg_buffer << cfg_file.rdbuf();
-    auto cfg = cfg_buffer.str();
+    if (print_stats || stats_json_path != "") {
+        options.stats = std::make_shared<Stats>();
+    }
 
-    return AppArgs{
+    AppArgs args{
         .config_path = config_path,
-        .config = cfg,
+        .config = read_file(config_path),
         .out_path = out_path,
         .in_paths = in_paths,
+        .options = options,
+        .stats_json_path = stats_json_path,
+        .print_stats = print_stats,
+        .trace_path = trace_path,
+        .batch_path = batch_path,
+        .batch = {},
+        .batch_threads = 1,
     };
+
+    if (batch_path != "") {
+        args.batch = parse_manifest(batch_path);
+
+        // in batch mode files are rendered in parallel instead of stages
+        args.batch_threads =
+            jobs_set ? options.jobs
+                     : std::max(std::thread::hardware_concurrency(), 1u);
+        args.options.jobs = 1;
+    }
+
+    return args;
+}
+
+void report_stats(const AppArgs &args, std::ostream &out, double seconds) {
+    if (!args.options.stats) {
+        return;
+    }
+
+    if (args.print_stats) {
+        args.options.stats->print(out, seconds);
+    }
+
+    if (args.stats_json_path != "") {
+        std::ofstream file(args.stats_json_path);
+        args.options.stats->write_json(file, seconds);
+        if (!file) {
+            std::cerr << "can't write stats to " << args.stats_json_path
+                      << std::endl;
+        }
+    }
+}
+
+void start_trace(const AppArgs &args) {
+    if (args.trace_path != "") {
+#ifdef APP_NO_TRACE
+        std::cerr << "built without trace support, the trace will be empty"
+                  << std::endl;
+#endif
+        Trace::get().start();
+        trace_thread_name("main");
+    }
+}
+
+void write_trace(const AppArgs &args) {
+    if (args.trace_path == "") {
+        return;
+    }
+
+    std::ofstream file(args.trace_path);
+    Trace::get().write(file);
+    if (!file) {
+        std::cerr << "can't write trace to " << args.trace_path << std::endl;
+    }
+}
+
+int run_batch(App &app, const AppArgs &args) {
+    Program program;
+    try {
+        program = app.compile(args.config);
+    } catch (ConfigException &e) {
+        pretty_print_error(args.config_path, args.config, e);
+        return 1;
+    } catch (std::runtime_error &e) {
+        std::cerr << "runtime error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << ESC "?25l";
+
+    start_trace(args);
+    auto report = app.run_batch(
+        program, args.batch, args.batch_threads, args.options,
+        [](size_t done, size_t total) {
+            std::cout << ESC "2K\r" << done << "/" << total << " files";
+            std::cout.flush();
+        });
+
+    std::cout << ESC "?25h" ESC "2K\r";
+
+    for (auto &failure : report.failures) {
+        std::cerr << failure.out_path << ": " << failure.error << std::endl;
+    }
+
+    std::cout << "rendered " << report.files << " files";
+    if (!report.failures.empty()) {
+        std::cout << " (" << report.failures.size() << " failed)";
+    }
+    std::cout << " in " << report.seconds << "s on " << args.batch_threads
+              << " threads: " << (double)report.files / report.seconds
+              << " files/s, " << (double)report.samples / report.seconds
+              << " samples/s\n";
+
+    report_stats(args, std::cout, report.seconds);
+    write_trace(args);
+
+    return report.failures.empty() ? 0 : 1;
 }
 
 int main(int argc, char **argv) {
@@ -80,22 +312,44 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    if (args.batch_path != "") {
+        return run_batch(app, args);
+    }
+
+    // progress goes to stderr when the audio itself is written to stdout
+    std::ostream &ui = args.out_path == "-" ? std::cerr : std::cout;
+
     // hide cursor
-    std::cout << ESC "?25l";
+    ui << ESC "?25l";
+
+    auto start = std::chrono::steady_clock::now();
+    start_trace(args);
 
     try {
-        app.run(args.config, args.out_path, args.in_paths, [](float progress) {
-            std::cout << ESC "2K\r" << progress * 100. << "%";
-            std::cout.flush();
-        });
+        app.run(args.config, args.out_path, args.in_paths, args.options,
+                [&ui](size_t done, std::optional<size_t> total) {
+                    ui << ESC "2K\r";
+                    if (total.has_value() && *total != 0) {
+                        ui << (float)done / (float)*total * 100. << "%";
+                    } else {
+                        ui << (float)done / 44100.f << "s";
+                    }
+                    ui.flush();
+                });
     } catch (ConfigException &e) {
-        std::cout << ESC "?25h" ESC "2K\r";
+        ui << ESC "?25h" ESC "2K\r";
         pretty_print_error(args.config_path, args.config, e);
         return 1;
     } catch (std::runtime_error &e) {
-        std::cout << ESC "?25h" ESC "2K\r";
+        ui << ESC "?25h" ESC "2K\r";
         std::cerr << "runtime error: " << e.what() << std::endl;
         return 1;
     }
-    std::cout << ESC "?25h" ESC "2K\rcomplete!\n";
-}
\ No newline at end of file
+    ui << ESC "?25h" ESC "2K\rcomplete!\n";
+
+    report_stats(args, ui,
+                 std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count());
+    write_trace(args);
+}
@@ -0,0 +1,521 @@
+#ifndef APP_ASYNC_OUTPUT_WRITER_H
+#define APP_ASYNC_OUTPUT_WRITER_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+// leaked from <linux/fs.h>, clashes with the streams' own constants
+#undef BLOCK_SIZE
+#undef BLOCK_SIZE_BITS
+#define APP_HAVE_IO_URING
+#endif
+
+#include "OutputWriter.hpp"
+#include "Trace.hpp"
+
+// backend of AsyncOutputWriter: writes whole buffers at file offsets in the
+// background. complete() waits until at least one write is done and
+// returns the ids of finished writes, or throws the error of a failed one.
+struct WriteQueue {
+    struct Done {
+        size_t id;
+        int error;
+    };
+
+    virtual void submit(size_t id, const char *data, size_t len,
+                        size_t offset) = 0;
+    virtual std::vector<Done> complete() = 0;
+    virtual ~WriteQueue() = default;
+};
+
+// pwrite on a background thread, works everywhere
+struct ThreadWriteQueue : public WriteQueue {
+    ThreadWriteQueue(int fd) : fd(fd), stopping(false) {
+        worker = std::thread([this]() { work(); });
+    }
+
+    ~ThreadWriteQueue() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    void submit(size_t id, const char *data, size_t len,
+                size_t offset) override {
+        {
+            std::lock_guard lock(mutex);
+            pending.push_back(Write{id, data, len, offset});
+        }
+        cv.notify_all();
+    }
+
+    std::vector<Done> complete() override {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [this]() { return !done.empty(); });
+        return std::exchange(done, {});
+    }
+
+  private:
+    struct Write {
+        size_t id;
+        const char *data;
+        size_t len;
+        size_t offset;
+    };
+
+    void work() {
+        trace_thread_name("writer");
+        while (true) {
+            Write write;
+            {
+                std::unique_lock lock(mutex);
+                cv.wait(lock,
+                        [this]() { return stopping || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                write = pending.front();
+                pending.pop_front();
+            }
+
+            int error = 0;
+            {
+                TraceScope trace("pwrite", "io", "bytes", write.len);
+                while (write.len != 0) {
+                    auto r = ::pwrite(fd, write.data, write.len, write.offset);
+                    if (r < 0 && errno == EINTR) {
+                        continue;
+                    } else if (r < 0) {
+                        error = errno;
+                        break;
+                    } else if (r == 0) {
+                        // no progress, trying again would loop forever
+                        error = EIO;
+                        break;
+                    }
+                    write.data += r;
+                    write.len -= r;
+                    write.offset += r;
+                }
+            }
+
+            {
+                std::lock_guard lock(mutex);
+                done.push_back(Done{write.id, error});
+            }
+            cv.notify_all();
+        }
+    }
+
+    int fd;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Write> pending;
+    std::vector<Done> done;
+    bool stopping;
+};
+
+#ifdef APP_HAVE_IO_URING
+// writes through an io_uring set up with the raw syscalls. create() returns
+// nullptr if the kernel doesn't allow io_uring or can't write through it,
+// the caller falls back to the thread then.
+struct UringWriteQueue : public WriteQueue {
+    static std::unique_ptr<UringWriteQueue> create(int fd, unsigned entries) {
+        auto queue = std::unique_ptr<UringWriteQueue>(new UringWriteQueue(fd));
+        if (!queue->setup(entries)) {
+            return nullptr;
+        }
+        return queue;
+    }
+
+    ~UringWriteQueue() {
+        if (sq_ring != MAP_FAILED) {
+            ::munmap(sq_ring, sq_ring_size);
+        }
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+            ::munmap(cq_ring, cq_ring_size);
+        }
+        if (sqes != MAP_FAILED) {
+            ::munmap(sqes, sqes_size);
+        }
+        if (ring_fd >= 0) {
+            ::close(ring_fd);
+        }
+    }
+
+    void submit(size_t id, const char *data, size_t len,
+                size_t offset) override {
+        writes.resize(std::max(writes.size(), id + 1));
+        writes[id] = Write{data, len, offset};
+        push(id);
+    }
+
+    std::vector<Done> complete() override {
+        std::vector<Done> result;
+        while (result.empty()) {
+            if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                throw std::system_error(errno, std::generic_category());
+            }
+
+            auto head = cq_head->load(std::memory_order_relaxed);
+            while (head != cq_tail->load(std::memory_order_acquire)) {
+                auto &cqe = cqes[head & cq_mask];
+                size_t id = cqe.user_data;
+                int res = cqe.res;
+                head++;
+                cq_head->store(head, std::memory_order_release);
+
+                auto &write = writes[id];
+                if (res < 0) {
+                    result.push_back(Done{id, -res});
+                } else if (res == 0) {
+                    // no progress, resubmitting would loop forever
+                    result.push_back(Done{id, EIO});
+                } else if ((size_t)res < write.len) {
+                    // short write, the rest goes in another request
+                    write.data += res;
+                    write.len -= res;
+                    write.offset += res;
+                    push(id);
+                } else {
+                    result.push_back(Done{id, 0});
+                }
+            }
+        }
+        return result;
+    }
+
+  private:
+    struct Write {
+        const char *data;
+        size_t len;
+        size_t offset;
+    };
+
+    UringWriteQueue(int fd) : fd(fd), ring_fd(-1) {
+    }
+
+    bool setup(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = ::syscall(__NR_io_uring_setup, entries, &params);
+        if (ring_fd < 0) {
+            return false;
+        }
+
+        sq_ring_size =
+            params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size =
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) {
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        }
+
+        sq_ring =
+            ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED) {
+            return false;
+        }
+        cq_ring = single ? sq_ring
+                         : ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, ring_fd,
+                                  IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            return false;
+        }
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        auto sq = (char *)sq_ring;
+        sq_tail = (std::atomic<unsigned> *)(sq + params.sq_off.tail);
+        sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+        sq_array = (unsigned *)(sq + params.sq_off.array);
+
+        auto cq = (char *)cq_ring;
+        cq_head = (std::atomic<unsigned> *)(cq + params.cq_off.head);
+        cq_tail = (std::atomic<unsigned> *)(cq + params.cq_off.tail);
+        cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+        // IORING_OP_WRITE came with linux 5.6, older kernels set up the ring
+        // and then fail every write with EINVAL
+        return supports(IORING_OP_WRITE);
+    }
+
+    // asks the kernel which opcodes it knows. the probe itself is as old
+    // as IORING_OP_WRITE, before that the call fails.
+    bool supports(unsigned op) {
+        const unsigned OPS = 256;
+        std::vector<char> buffer(sizeof(io_uring_probe) +
+                                 OPS * sizeof(io_uring_probe_op));
+        auto probe = (io_uring_probe *)buffer.data();
+        if (::syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE,
+                      probe, OPS) < 0) {
+            return false;
+        }
+        return op <= probe->last_op &&
+               (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+
+    // the ring has more entries than the writer has buffers, so it can't
+    // be full here
+    void push(size_t id) {
+        auto &write = writes[id];
+        auto tail = sq_tail->load(std::memory_order_relaxed);
+        auto index = tail & sq_mask;
+
+        auto &sqe = ((io_uring_sqe *)sqes)[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITE;
+        sqe.fd = fd;
+        sqe.addr = (std::uint64_t)write.data;
+        sqe.len = write.len;
+        sqe.off = write.offset;
+        sqe.user_data = id;
+
+        sq_array[index] = index;
+        sq_tail->store(tail + 1, std::memory_order_release);
+
+        while (enter(1, 0, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN) {
+                throw std::system_error(errno, std::generic_category());
+            }
+        }
+    }
+
+    int enter(unsigned submit, unsigned wait, unsigned flags) {
+        return ::syscall(__NR_io_uring_enter, ring_fd, submit, wait, flags,
+                         nullptr, 0);
+    }
+
+    int fd;
+    int ring_fd;
+
+    void *sq_ring = MAP_FAILED;
+    void *cq_ring = MAP_FAILED;
+    void *sqes = MAP_FAILED;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    size_t sqes_size = 0;
+
+    std::atomic<unsigned> *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    std::atomic<unsigned> *cq_head;
+    std::atomic<unsigned> *cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe *cqes;
+
+    std::vector<Write> writes;
+};
+#endif
+
+// writes a file without blocking the render thread: data is collected in
+// large aligned buffers and a full buffer is handed to io_uring (or a
+// writer thread where io_uring isn't available) while rendering continues
+// into the next one. the render thread only waits when every buffer is
+// still being written. `uring` set to false always uses the thread.
+struct AsyncOutputWriter : public OutputWriter {
+    AsyncOutputWriter(const std::string &path, size_t buffer_count = 4,
+                      size_t buffer_size = 1 << 20, bool uring = true)
+        : buffer_size(buffer_size), buffers(buffer_count), current(0),
+          filled(0), position(0), in_flight(0), error(0) {
+        for (auto &buffer : buffers) {
+            void *data;
+            if (::posix_memalign(&data, 4096, buffer_size) != 0) {
+                throw std::bad_alloc();
+            }
+            buffer.data.reset((char *)data);
+            free_buffers.push_back(&buffer - buffers.data());
+        }
+        current = take_buffer();
+
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0666);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+
+#ifdef APP_HAVE_IO_URING
+        if (uring) {
+            queue = UringWriteQueue::create(fd, buffer_count * 2);
+            uses_uring = queue != nullptr;
+        }
+#endif
+        if (!queue) {
+            queue = std::make_unique<ThreadWriteQueue>(fd);
+        }
+    }
+
+    AsyncOutputWriter(const AsyncOutputWriter &) = delete;
+    AsyncOutputWriter &operator=(const AsyncOutputWriter &) = delete;
+
+    // errors are lost here, call flush() to see them
+    ~AsyncOutputWriter() {
+        try {
+            submit_current();
+            wait_all();
+        } catch (...) {
+        }
+        queue.reset();
+        ::close(fd);
+    }
+
+    void write(char *data, size_t len) override {
+        while (len != 0) {
+            size_t n = std::min(len, buffer_size - filled);
+            std::memcpy(buffers[current].data.get() + filled, data, n);
+            filled += n;
+            data += n;
+            len -= n;
+
+            if (filled == buffer_size) {
+                submit_current();
+                current = take_buffer();
+            }
+        }
+    }
+
+    bool seekable() const override {
+        return true;
+    }
+
+    // whether writes go through io_uring rather than the thread
+    bool uring() const {
+        return uses_uring;
+    }
+
+    // writes to other places may overlap ones still in flight, so
+    // everything is written out first
+    void seek(size_t pos) override {
+        submit_current();
+        wait_all();
+        current = take_buffer();
+        position = pos;
+    }
+
+    void flush() override {
+        submit_current();
+        wait_all();
+        current = take_buffer();
+    }
+
+  private:
+    struct Free {
+        void operator()(char *data) const {
+            std::free(data);
+        }
+    };
+
+    struct Buffer {
+        std::unique_ptr<char, Free> data;
+    };
+
+    void submit_current() {
+        if (current == NONE) {
+            return;
+        }
+        if (filled == 0) {
+            free_buffers.push_back(current);
+            current = NONE;
+            return;
+        }
+
+        queue->submit(current, buffers[current].data.get(), filled, position);
+        position += filled;
+        filled = 0;
+        current = NONE;
+        in_flight++;
+    }
+
+    size_t take_buffer() {
+        while (free_buffers.empty()) {
+            reap();
+        }
+        auto id = free_buffers.back();
+        free_buffers.pop_back();
+        return id;
+    }
+
+    void wait_all() {
+        while (in_flight != 0) {
+            reap();
+        }
+        if (error != 0) {
+            auto e = std::exchange(error, 0);
+            throw std::system_error(e, std::generic_category());
+        }
+    }
+
+    void reap() {
+        TraceScope trace("wait for writes", "io");
+        for (auto done : queue->complete()) {
+            if (done.error != 0 && error == 0) {
+                error = done.error;
+            }
+            free_buffers.push_back(done.id);
+            in_flight--;
+        }
+        if (error != 0) {
+            auto e = std::exchange(error, 0);
+            wait_quietly();
+            throw std::system_error(e, std::generic_category());
+        }
+    }
+
+    // after an error the other writes still have to finish before their
+    // buffers can be reused or freed
+    void wait_quietly() {
+        while (in_flight != 0) {
+            for (auto done : queue->complete()) {
+                free_buffers.push_back(done.id);
+                in_flight--;
+            }
+        }
+    }
+
+    static constexpr size_t NONE = (size_t)-1;
+
+    int fd;
+    size_t buffer_size;
+    std::vector<Buffer> buffers;
+    std::vector<size_t> free_buffers;
+    size_t current;
+    size_t filled;
+    size_t position;
+    size_t in_flight;
+    int error;
+
+    std::unique_ptr<WriteQueue> queue;
+    bool uses_uring = false;
+};
+
+#endif
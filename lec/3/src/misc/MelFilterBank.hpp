@@ -1,17 +1,21 @@
 #ifndef APP_MEL_FILTER_BANK_H
 #define APP_MEL_FILTER_BANK_H
 
+#include <algorithm>
 #include <cmath>
 #include <span>
 #include <vector>
 
+#include "simd.hpp"
+
+// triangular filters are stored sparsely: every band keeps only the range
+// of spectrum bins it covers
 struct MelFilterBank {
     MelFilterBank(size_t spectrum_length, float min_freq, float max_freq,
                   size_t sample_rate, size_t bands)
         : spectrum_length(spectrum_length), min_freq(min_freq),
           max_freq(max_freq), bands(bands), sample_rate(sample_rate),
-          mat(bands * spectrum_length),
-          reconstruct_mat(bands * spectrum_length) {
+          band_start(bands), weights_offset(bands + 1) {
 
         prepare();
     }
@@ -19,20 +23,17 @@ struct MelFilterBank {
     void apply(const std::span<float> input,
                std::span<float> output) const noexcept {
         for (size_t i = 0; i < bands; i++) {
-            output[i] = 0.;
-            for (size_t j = 0; j < spectrum_length; j++) {
-                output[i] += mat[i * spectrum_length + j] * input[j];
-            }
+            output[i] = simd_dot(weights.data() + weights_offset[i],
+                                 input.data() + band_start[i], band_size(i));
         }
     }
 
     void reconstruct(const std::span<float> input,
                      std::span<float> output) const noexcept {
-        for (size_t i = 0; i < spectrum_length; i++) {
-            output[i] = 0.;
-            for (size_t j = 0; j < bands; j++) {
-                output[i] += mat[j * spectrum_length + i] * input[j];
-            }
+        std::fill(output.begin(), output.begin() + spectrum_length, 0.f);
+        for (size_t i = 0; i < bands; i++) {
+            simd_axpy(input[i], weights.data() + weights_offset[i],
+                      output.data() + band_start[i], band_size(i));
         }
     }
 
@@ -43,8 +44,13 @@ struct MelFilterBank {
     float max_freq;
     size_t bands;
 
-    std::vector<float> mat;
-    std::vector<float> reconstruct_mat;
+    std::vector<size_t> band_start;
+    std::vector<size_t> weights_offset;
+    std::vector<float> weights;
+
+    size_t band_size(size_t band) const noexcept {
+        return weights_offset[band + 1] - weights_offset[band];
+    }
 
     static float freq2mel(float f) {
         return 1125. * std::log(1. + (f / 700.));
@@ -63,14 +69,16 @@ struct MelFilterBank {
             auto end_f = mel2freq((float)(band + 2) * norm + min_mel);
             size_t start = (spectrum_length + 1) * start_f / sample_rate;
             size_t end = (spectrum_length + 1) * end_f / sample_rate;
-            triangle(
-                std::span(mat.data() + band * spectrum_length, spectrum_length),
-                start, end);
-        }
-    }
+            start = std::min(start, spectrum_length);
+            end = std::clamp(end, start, spectrum_length);
 
-    static void triangle(std::span<float> arr, size_t start, size_t end) {
-        triangle(std::span(arr.data() + start, end - start));
+            band_start[band] = start;
+            weights_offset[band] = weights.size();
+            weights.resize(weights.size() + end - start);
+            triangle(std::span(weights.data() + weights_offset[band],
+                               end - start));
+        }
+        weights_offset[bands] = weights.size();
     }
 
     static void triangle(std::span<float> arr) {
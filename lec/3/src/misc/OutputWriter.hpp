@@ -1,13 +1,20 @@
 #ifndef APP_OUTPUT_WRITER_H
 #define APP_OUTPUT_WRITER_H
 
+#include <cerrno>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <span>
+#include <stdexcept>
 #include <string>
+#include <system_error>
 #include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 struct OutputWriter {
     virtual void write(std::span<char> out) {
         write(out.data(), out.size());
@@ -17,6 +24,21 @@ struct OutputWriter {
         write(std::span(data, len));
     }
 
+    // whether seek() can be used, false for pipes and terminals
+    virtual bool seekable() const {
+        return false;
+    }
+
+    // moves the write position to `pos` bytes from the start
+    virtual void seek([[maybe_unused]] size_t pos) {
+        throw std::runtime_error("output is not seekable");
+    }
+
+    // waits until everything written so far has reached the file and
+    // throws if any of it failed
+    virtual void flush() {
+    }
+
     virtual ~OutputWriter() = default;
 };
 
@@ -24,21 +46,88 @@ struct FileOutputWriter : public OutputWriter {
     FileOutputWriter(const std::string &filename) : stream() {
         stream.exceptions(std::ofstream::failbit);
         stream.open(filename);
+        regular = std::filesystem::is_regular_file(filename);
     }
 
     virtual void write(char *data, size_t len) override {
         stream.write(data, len);
     }
 
+    bool seekable() const override {
+        return regular;
+    }
+
+    void seek(size_t pos) override {
+        stream.seekp(pos);
+    }
+
+    void flush() override {
+        stream.flush();
+    }
+
   private:
     std::ofstream stream;
+    bool regular;
+};
+
+// writes to an already open file descriptor, like stdout. positions are
+// counted from where the descriptor was when the writer was created, so
+// `>` redirections into the middle of a file work. descriptors opened with
+// O_APPEND (`>>`) write at the end whatever the position is, so they count
+// as not seekable.
+struct FdOutputWriter : public OutputWriter {
+    FdOutputWriter(int fd) : fd(fd), start(::lseek(fd, 0, SEEK_CUR)) {
+        int flags = ::fcntl(fd, F_GETFL);
+        can_seek = start >= 0 && flags >= 0 && (flags & O_APPEND) == 0;
+    }
+
+    virtual void write(char *data, size_t len) override {
+        while (len != 0) {
+            auto r = ::write(fd, data, len);
+            if (r < 0 && errno == EINTR) {
+                continue;
+            } else if (r < 0) {
+                throw std::system_error(errno, std::generic_category());
+            }
+            data += r;
+            len -= r;
+        }
+    }
+
+    bool seekable() const override {
+        return can_seek;
+    }
+
+    void seek(size_t pos) override {
+        if (::lseek(fd, start + (off_t)pos, SEEK_SET) < 0) {
+            throw std::system_error(errno, std::generic_category());
+        }
+    }
+
+  private:
+    int fd;
+    off_t start;
+    bool can_seek;
 };
 
 struct VectorOutputWriter : public OutputWriter {
+    VectorOutputWriter() : pos(0) {
+    }
+
     virtual void write(char *data, size_t len) override {
-        auto size = vector.size();
-        vector.resize(size + len);
-        std::memcpy(vector.data() + size, data, len);
+        if (pos + len > vector.size()) {
+            vector.resize(pos + len);
+        }
+        std::memcpy(vector.data() + pos, data, len);
+        pos += len;
+    }
+
+    bool seekable() const override {
+        return true;
+    }
+
+    void seek(size_t new_pos) override {
+        pos = new_pos;
     }
 
     std::vector<char> to_vector() {
@@ -47,6 +136,7 @@ struct VectorOutputWriter : public OutputWriter {
 
   private:
     std::vector<char> vector;
+    size_t pos;
 };
 
 #endif
\ No newline at end of file
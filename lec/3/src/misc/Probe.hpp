@@ -0,0 +1,83 @@
+#ifndef APP_PROBE_H
+#define APP_PROBE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+#include "Trace.hpp"
+
+// counters of one node of the stream graph. time is measured exclusive of
+// the probed nodes the node reads from: every thread keeps a stack of the
+// measurements in progress and a nested measurement subtracts itself from
+// the one it runs in. while tracing, every measured call is also recorded
+// as an event named after the node.
+struct Probe {
+    Probe(std::string label) : label(std::move(label)) {
+    }
+
+    struct Frame {
+        Frame *parent;
+        std::uint64_t child_wall;
+        std::uint64_t child_cpu;
+    };
+
+    // measures one call into the node, `samples` is set by the caller
+    struct Scope {
+        Scope(Probe &probe)
+            : probe(probe), frame{current(), 0, 0}, wall(now(CLOCK_MONOTONIC)),
+              cpu(now(CLOCK_THREAD_CPUTIME_ID)), samples(0),
+              trace(probe.label, "stream") {
+            current() = &frame;
+        }
+
+        Scope(const Scope &) = delete;
+
+        ~Scope() {
+            auto wall_spent = now(CLOCK_MONOTONIC) - wall;
+            auto cpu_spent = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+            current() = frame.parent;
+            if (frame.parent != nullptr) {
+                frame.parent->child_wall += wall_spent;
+                frame.parent->child_cpu += cpu_spent;
+            }
+
+            probe.calls.fetch_add(1, std::memory_order_relaxed);
+            probe.samples.fetch_add(samples, std::memory_order_relaxed);
+            probe.wall_ns.fetch_add(wall_spent - frame.child_wall,
+                                    std::memory_order_relaxed);
+            probe.cpu_ns.fetch_add(cpu_spent - frame.child_cpu,
+                                   std::memory_order_relaxed);
+            trace.set_arg("samples", samples);
+        }
+
+        Probe &probe;
+        Frame frame;
+        std::uint64_t wall;
+        std::uint64_t cpu;
+        size_t samples;
+        TraceScope trace;
+    };
+
+    std::string label;
+    std::atomic<std::uint64_t> samples = 0;
+    std::atomic<std::uint64_t> calls = 0;
+    std::atomic<std::uint64_t> wall_ns = 0;
+    std::atomic<std::uint64_t> cpu_ns = 0;
+
+  private:
+    static Frame *&current() {
+        static thread_local Frame *frame = nullptr;
+        return frame;
+    }
+
+    static std::uint64_t now(clockid_t clock) {
+        timespec ts;
+        clock_gettime(clock, &ts);
+        return (std::uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef APP_RING_BUFFER_H
+#define APP_RING_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// lock-free single-producer/single-consumer ring of preallocated items.
+// indices only grow, the slot is index % capacity. blocking is done with
+// atomic wait/notify on a signal counter of the other side.
+template <typename T> struct SpscRing {
+    SpscRing(size_t capacity, const T &init = T())
+        : items(capacity, init), head(0), tail(0), closed(false),
+          cancelled(false), produced(0), consumed(0) {
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // producer: slot to fill, waits while the ring is full. returns nullptr
+    // if the consumer went away.
+    T *begin_push() {
+        while (true) {
+            auto signal = consumed.load(std::memory_order_acquire);
+            if (cancelled.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            auto h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) < items.size()) {
+                return &items[h % items.size()];
+            }
+            consumed.wait(signal, std::memory_order_acquire);
+        }
+    }
+
+    void end_push() {
+        head.store(head.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+        signal(produced);
+    }
+
+    // producer: no more items will be pushed
+    void close() {
+        closed.store(true, std::memory_order_release);
+        signal(produced);
+    }
+
+    // consumer: oldest item, waits while the ring is empty. returns nullptr
+    // if the ring is empty and closed.
+    T *front() {
+        while (true) {
+            auto signal = produced.load(std::memory_order_acquire);
+            auto t = tail.load(std::memory_order_relaxed);
+            if (head.load(std::memory_order_acquire) != t) {
+                return &items[t % items.size()];
+            }
+            if (closed.load(std::memory_order_acquire)) {
+                // an item may have been pushed right before closing
+                if (head.load(std::memory_order_acquire) != t) {
+                    continue;
+                }
+                return nullptr;
+            }
+            produced.wait(signal, std::memory_order_acquire);
+        }
+    }
+
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+        signal(consumed);
+    }
+
+    // consumer: calls f on every item pushed and not popped yet, oldest
+    // first. the producer must not push meanwhile.
+    template <typename F> void each(F f) const {
+        auto h = head.load(std::memory_order_acquire);
+        for (auto t = tail.load(std::memory_order_relaxed); t != h; t++) {
+            f(items[t % items.size()]);
+        }
+    }
+
+    // consumer: stop the producer, it may be blocked in begin_push
+    void cancel() {
+        cancelled.store(true, std::memory_order_release);
+        signal(consumed);
+    }
+
+    // lets a new producer continue after cancel(), the items in the ring are
+    // kept. the old producer must have stopped.
+    void resume() {
+        cancelled.store(false, std::memory_order_relaxed);
+    }
+
+    // empties the ring so it can be used again. neither side may be using
+    // it at that point.
+    void reset() {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        closed.store(false, std::memory_order_relaxed);
+        cancelled.store(false, std::memory_order_relaxed);
+    }
+
+  private:
+    static void signal(std::atomic<std::uint32_t> &counter) {
+        counter.fetch_add(1, std::memory_order_release);
+        counter.notify_one();
+    }
+
+    std::vector<T> items;
+
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+
+    std::atomic<bool> closed;
+    std::atomic<bool> cancelled;
+
+    std::atomic<std::uint32_t> produced;
+    std::atomic<std::uint32_t> consumed;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef APP_STATS_H
+#define APP_STATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Probe.hpp"
+
+// probes of the nodes of a render, reported once it's done. probes with the
+// same label (like the same stage of different files in batch mode) are
+// reported as one node.
+struct Stats {
+    struct Node {
+        std::string label;
+        std::uint64_t samples = 0;
+        std::uint64_t calls = 0;
+        std::uint64_t wall_ns = 0;
+        std::uint64_t cpu_ns = 0;
+    };
+
+    std::shared_ptr<Probe> add(std::string label) {
+        std::lock_guard lock(mutex);
+        probes.push_back(std::make_shared<Probe>(std::move(label)));
+        return probes.back();
+    }
+
+    // nodes in the order they were added
+    std::vector<Node> nodes() const {
+        std::lock_guard lock(mutex);
+        std::vector<Node> result;
+        for (auto &probe : probes) {
+            auto it = std::find_if(
+                result.begin(), result.end(),
+                [&](const Node &node) { return node.label == probe->label; });
+            if (it == result.end()) {
+                result.push_back(Node{.label = probe->label});
+                it = result.end() - 1;
+            }
+            it->samples += probe->samples.load(std::memory_order_relaxed);
+            it->calls += probe->calls.load(std::memory_order_relaxed);
+            it->wall_ns += probe->wall_ns.load(std::memory_order_relaxed);
+            it->cpu_ns += probe->cpu_ns.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    // `seconds` is the wall time of the whole render
+    void print(std::ostream &out, double seconds) const {
+        auto list = nodes();
+
+        size_t width = 4;
+        for (auto &node : list) {
+            width = std::max(width, node.label.size());
+        }
+
+        out << std::left << std::setw(width) << "node" << std::right
+            << std::setw(12) << "samples" << std::setw(9) << "reads"
+            << std::setw(10) << "avg block" << std::setw(11) << "wall ms"
+            << std::setw(11) << "cpu ms" << std::setw(8) << "wall %"
+            << std::setw(13) << "samples/s" << "\n";
+
+        out << std::fixed;
+        for (auto &node : list) {
+            double wall = node.wall_ns / 1e9;
+            out << std::left << std::setw(width) << node.label << std::right
+                << std::setw(12) << node.samples << std::setw(9) << node.calls
+                << std::setw(10) << std::setprecision(0)
+                << (node.calls ? (double)node.samples / node.calls : 0.)
+                << std::setw(11) << std::setprecision(1) << wall * 1e3
+                << std::setw(11) << node.cpu_ns / 1e6 << std::setw(8)
+                << (seconds > 0. ? wall / seconds * 100. : 0.)
+                << std::setw(13) << std::setprecision(0)
+                << (wall > 0. ? node.samples / wall : 0.) << "\n";
+        }
+        out << std::defaultfloat << std::setprecision(6);
+        out << "total " << seconds * 1e3 << " ms\n";
+    }
+
+    void write_json(std::ostream &out, double seconds) const {
+        out << "{\"seconds\": " << seconds << ", \"nodes\": [";
+        bool first = true;
+        for (auto &node : nodes()) {
+            out << (first ? "" : ", ") << "{\"label\": ";
+            write_string(out, node.label);
+            out << ", \"samples\": " << node.samples
+                << ", \"reads\": " << node.calls
+                << ", \"wall_ns\": " << node.wall_ns
+                << ", \"cpu_ns\": " << node.cpu_ns << "}";
+            first = false;
+        }
+        out << "]}\n";
+    }
+
+  private:
+    static void write_string(std::ostream &out, const std::string &s) {
+        out << '"';
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (c < 0x20) {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                    << (int)c << std::dec << std::setfill(' ');
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<Probe>> probes;
+};
+
+#endif
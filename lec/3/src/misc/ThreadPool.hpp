@@ -0,0 +1,132 @@
+#ifndef APP_THREAD_POOL_H
+#define APP_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "Trace.hpp"
+
+struct ThreadPool {
+    ThreadPool(size_t threads) : stopping(false) {
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    size_t size() const noexcept {
+        return workers.size();
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard lock(mutex);
+            tasks.push(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    // calls f(index, slot) for every index in [0, n) and waits for all of
+    // them. the calling thread takes part in the work, so this also makes
+    // progress when all workers are busy. slot is unique among the calls
+    // running at the same time and is less than size() + 1, it can be used
+    // to pick per-thread scratch buffers.
+    template <typename F> void parallel_for(size_t n, F &&f) {
+        if (n == 0) {
+            return;
+        }
+
+        struct Job {
+            size_t n;
+            std::atomic<size_t> next = 0;
+            std::atomic<size_t> done = 0;
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::exception_ptr error;
+        };
+
+        auto job = std::make_shared<Job>();
+        job->n = n;
+
+        // helpers that start after all indices are taken return right away
+        // and never touch f
+        auto run = [job, &f](size_t slot) {
+            size_t i;
+            while ((i = job->next.fetch_add(1)) < job->n) {
+                try {
+                    f(i, slot);
+                } catch (...) {
+                    std::lock_guard lock(job->mutex);
+                    if (!job->error) {
+                        job->error = std::current_exception();
+                    }
+                }
+
+                if (job->done.fetch_add(1) + 1 == job->n) {
+                    std::lock_guard lock(job->mutex);
+                    job->cv.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = std::min(size(), n - 1);
+        for (size_t slot = 1; slot <= helpers; slot++) {
+            submit([run, slot]() { run(slot); });
+        }
+
+        run(0);
+
+        std::unique_lock lock(job->mutex);
+        job->cv.wait(lock, [&]() { return job->done.load() == job->n; });
+
+        if (job->error) {
+            std::rethrow_exception(job->error);
+        }
+    }
+
+  private:
+    void work() {
+        trace_thread_name("pool");
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping;
+};
+
+#endif
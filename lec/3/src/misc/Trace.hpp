@@ -0,0 +1,214 @@
+#ifndef APP_TRACE_H
+#define APP_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// timeline of a render in the chrome trace event format, viewable in
+// perfetto or chrome://tracing. recording is switched on at runtime with
+// Trace::start(), while it's off a TraceScope costs one relaxed load.
+// building with APP_NO_TRACE removes the scopes entirely.
+struct Trace {
+    struct Event {
+        std::string name;
+        const char *category;
+        std::uint64_t start;
+        std::uint64_t duration;
+        // optional numeric argument, shown when the event is selected
+        const char *arg_name;
+        std::int64_t arg;
+    };
+
+    // events of one thread, only that thread appends to it
+    struct Buffer {
+        size_t tid;
+        std::string thread_name;
+        std::vector<Event> events;
+    };
+
+    static Trace &get() {
+        static Trace trace;
+        return trace;
+    }
+
+    static bool enabled() noexcept {
+#ifdef APP_NO_TRACE
+        return false;
+#else
+        return get().recording.load(std::memory_order_relaxed);
+#endif
+    }
+
+    void start() {
+        origin = now();
+        recording.store(true, std::memory_order_relaxed);
+    }
+
+    // stops recording and writes the events of all threads. threads that
+    // recorded events must not be running anymore.
+    void write(std::ostream &out) {
+        recording.store(false, std::memory_order_relaxed);
+
+        std::lock_guard lock(mutex);
+        out << "{\"traceEvents\": [\n";
+        bool first = true;
+        for (auto &buffer : buffers) {
+            if (buffer->thread_name != "") {
+                out << (first ? "" : ",\n")
+                    << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                       "\"tid\": "
+                    << buffer->tid << ", \"args\": {\"name\": ";
+                write_string(out, buffer->thread_name);
+                out << "}}";
+                first = false;
+            }
+
+            for (auto &event : buffer->events) {
+                out << (first ? "" : ",\n") << "{\"name\": ";
+                write_string(out, event.name);
+                out << ", \"cat\": \"" << event.category
+                    << "\", \"ph\": \"X\", \"ts\": ";
+                write_micros(out, event.start - origin);
+                out << ", \"dur\": ";
+                write_micros(out, event.duration);
+                out << ", \"pid\": 1, \"tid\": " << buffer->tid;
+                if (event.arg_name != nullptr) {
+                    out << ", \"args\": {\"" << event.arg_name
+                        << "\": " << event.arg << "}";
+                }
+                out << "}";
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+    }
+
+    // buffer of the calling thread, created on first use
+    Buffer &local() {
+        static thread_local std::shared_ptr<Buffer> buffer;
+        if (!buffer) {
+            buffer = std::make_shared<Buffer>();
+            std::lock_guard lock(mutex);
+            buffer->tid = buffers.size() + 1;
+            buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    static std::uint64_t now() noexcept {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (std::uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+  private:
+    // nanoseconds as microseconds with three decimals, so timestamps keep
+    // their full resolution however long the render runs
+    static void write_micros(std::ostream &out, std::uint64_t ns) {
+        auto fraction = ns % 1000;
+        out << ns / 1000 << '.' << (char)('0' + fraction / 100)
+            << (char)('0' + fraction / 10 % 10) << (char)('0' + fraction % 10);
+    }
+
+    static void write_string(std::ostream &out, const std::string &s) {
+        out << '"';
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (c >= 0x20) {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    std::atomic<bool> recording = false;
+    std::uint64_t origin = 0;
+
+    std::mutex mutex;
+    // kept after their threads exit, so the events can still be written
+    std::vector<std::shared_ptr<Buffer>> buffers;
+};
+
+// names the calling thread in the trace
+static void trace_thread_name(const std::string &name) {
+    if (Trace::enabled()) {
+        Trace::get().local().thread_name = name;
+    }
+}
+
+// records the lifetime of the scope as one event
+struct TraceScope {
+#ifdef APP_NO_TRACE
+    TraceScope(const char *, const char *, const char * = nullptr,
+               std::int64_t = 0) {
+    }
+    TraceScope(const std::string &, const char *, const char * = nullptr,
+               std::int64_t = 0) {
+    }
+
+    void set_arg(const char *, std::int64_t) {
+    }
+#else
+    TraceScope(const char *name, const char *category,
+               const char *arg_name = nullptr, std::int64_t arg = 0)
+        : active(Trace::enabled()) {
+        if (active) {
+            begin(name, category, arg_name, arg);
+        }
+    }
+
+    TraceScope(const std::string &name, const char *category,
+               const char *arg_name = nullptr, std::int64_t arg = 0)
+        : active(Trace::enabled()) {
+        if (active) {
+            begin(name.c_str(), category, arg_name, arg);
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+
+    // replaces the argument, for values known only at the end
+    void set_arg(const char *arg_name, std::int64_t arg) {
+        if (active) {
+            auto &event = Trace::get().local().events[index];
+            event.arg_name = arg_name;
+            event.arg = arg;
+        }
+    }
+
+    ~TraceScope() {
+        if (active) {
+            auto &buffer = Trace::get().local();
+            auto &event = buffer.events[index];
+            event.duration = Trace::now() - event.start;
+        }
+    }
+
+  private:
+    void begin(const char *name, const char *category, const char *arg_name,
+               std::int64_t arg) {
+        auto &buffer = Trace::get().local();
+        index = buffer.events.size();
+        buffer.events.push_back(Event{.name = name,
+                                      .category = category,
+                                      .start = Trace::now(),
+                                      .duration = 0,
+                                      .arg_name = arg_name,
+                                      .arg = arg});
+    }
+
+    using Event = Trace::Event;
+
+    bool active;
+    size_t index;
+#endif
+};
+
+#endif
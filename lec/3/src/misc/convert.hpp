@@ -0,0 +1,220 @@
+#ifndef APP_CONVERT_H
+#define APP_CONVERT_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define APP_CONVERT_X86
+#include <immintrin.h>
+#endif
+
+// int16 <-> float sample conversion. float -> int16 truncates towards zero
+// (or rounds to nearest when dithered) and saturates at the int16 range.
+
+static void int16_to_float_scalar(const void *in, float *out, size_t n) {
+    auto bytes = (const char *)in;
+    for (size_t i = 0; i < n; i++) {
+        std::int16_t sample;
+        std::memcpy(&sample, bytes + i * 2, 2);
+        out[i] = sample;
+    }
+}
+
+static inline float clamp_int16(float x) {
+    // written so that NaN ends up as the upper bound, same as minps/maxps
+    x = x < 32767.f ? x : 32767.f;
+    x = x > -32768.f ? x : -32768.f;
+    return x;
+}
+
+static void float_to_int16_scalar(const float *in, std::int16_t *out,
+                                  size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (std::int16_t)clamp_int16(in[i]);
+    }
+}
+
+static void float_to_int16_dither_scalar(const float *in, const float *noise,
+                                         std::int16_t *out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (std::int16_t)std::lrint(clamp_int16(in[i] + noise[i]));
+    }
+}
+
+#ifdef APP_CONVERT_X86
+
+__attribute__((target("sse2"))) static void
+int16_to_float_sse2(const void *in, float *out, size_t n) {
+    auto bytes = (const char *)in;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(bytes + i * 2));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + i, _mm_cvtepi32_ps(lo));
+        _mm_storeu_ps(out + i + 4, _mm_cvtepi32_ps(hi));
+    }
+    int16_to_float_scalar(bytes + i * 2, out + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+int16_to_float_avx2(const void *in, float *out, size_t n) {
+    auto bytes = (const char *)in;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(bytes + i * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *)(bytes + i * 2 + 16));
+        _mm256_storeu_ps(out + i,
+                         _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a)));
+        _mm256_storeu_ps(out + i + 8,
+                         _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b)));
+    }
+    int16_to_float_scalar(bytes + i * 2, out + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+float_to_int16_sse2(const float *in, std::int16_t *out, size_t n) {
+    const __m128 lo = _mm_set1_ps(-32768.f);
+    const __m128 hi = _mm_set1_ps(32767.f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i), hi), lo);
+        __m128 b = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i + 4), hi), lo);
+        __m128i packed =
+            _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storeu_si128((__m128i *)(out + i), packed);
+    }
+    float_to_int16_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+float_to_int16_avx2(const float *in, std::int16_t *out, size_t n) {
+    const __m256 lo = _mm256_set1_ps(-32768.f);
+    const __m256 hi = _mm256_set1_ps(32767.f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a =
+            _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(in + i), hi), lo);
+        __m256 b =
+            _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(in + i + 8), hi), lo);
+        // packs works per 128-bit lane, permute restores sample order
+        __m256i packed = _mm256_packs_epi32(_mm256_cvttps_epi32(a),
+                                            _mm256_cvttps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, 0b11011000);
+        _mm256_storeu_si256((__m256i *)(out + i), packed);
+    }
+    float_to_int16_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+float_to_int16_dither_sse2(const float *in, const float *noise,
+                           std::int16_t *out, size_t n) {
+    const __m128 lo = _mm_set1_ps(-32768.f);
+    const __m128 hi = _mm_set1_ps(32767.f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_add_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(noise + i));
+        __m128 b =
+            _mm_add_ps(_mm_loadu_ps(in + i + 4), _mm_loadu_ps(noise + i + 4));
+        a = _mm_max_ps(_mm_min_ps(a, hi), lo);
+        b = _mm_max_ps(_mm_min_ps(b, hi), lo);
+        __m128i packed =
+            _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i *)(out + i), packed);
+    }
+    float_to_int16_dither_scalar(in + i, noise + i, out + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+float_to_int16_dither_avx2(const float *in, const float *noise,
+                           std::int16_t *out, size_t n) {
+    const __m256 lo = _mm256_set1_ps(-32768.f);
+    const __m256 hi = _mm256_set1_ps(32767.f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a = _mm256_add_ps(_mm256_loadu_ps(in + i),
+                                 _mm256_loadu_ps(noise + i));
+        __m256 b = _mm256_add_ps(_mm256_loadu_ps(in + i + 8),
+                                 _mm256_loadu_ps(noise + i + 8));
+        a = _mm256_max_ps(_mm256_min_ps(a, hi), lo);
+        b = _mm256_max_ps(_mm256_min_ps(b, hi), lo);
+        __m256i packed =
+            _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, 0b11011000);
+        _mm256_storeu_si256((__m256i *)(out + i), packed);
+    }
+    float_to_int16_dither_scalar(in + i, noise + i, out + i, n - i);
+}
+
+#endif
+
+struct ConvertKernels {
+    void (*to_float)(const void *, float *, size_t);
+    void (*to_int16)(const float *, std::int16_t *, size_t);
+    void (*to_int16_dither)(const float *, const float *, std::int16_t *,
+                            size_t);
+};
+
+// picks the widest kernels supported by the running cpu
+static const ConvertKernels &convert_kernels() {
+    static const ConvertKernels kernels = []() {
+#ifdef APP_CONVERT_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return ConvertKernels{int16_to_float_avx2, float_to_int16_avx2,
+                                  float_to_int16_dither_avx2};
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return ConvertKernels{int16_to_float_sse2, float_to_int16_sse2,
+                                  float_to_int16_dither_sse2};
+        }
+#endif
+        return ConvertKernels{int16_to_float_scalar, float_to_int16_scalar,
+                              float_to_int16_dither_scalar};
+    }();
+    return kernels;
+}
+
+// `in` points to little-endian int16 samples, it doesn't have to be aligned
+static void int16_to_float(const void *in, std::span<float> out) {
+    convert_kernels().to_float(in, out.data(), out.size());
+}
+
+static void float_to_int16(std::span<const float> in, std::int16_t *out) {
+    convert_kernels().to_int16(in.data(), out, in.size());
+}
+
+// triangular (TPDF) dither noise of +-1 LSB
+struct TpdfDither {
+    TpdfDither(std::uint32_t seed = 0x9e3779b9) : state(seed) {
+    }
+
+    void fill(std::span<float> noise) {
+        for (size_t i = 0; i < noise.size(); i++) {
+            noise[i] = uniform() - uniform();
+        }
+    }
+
+  private:
+    float uniform() {
+        // xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (float)(state >> 8) * (1.f / 16777216.f);
+    }
+
+    std::uint32_t state;
+};
+
+static void float_to_int16_dither(std::span<const float> in,
+                                  std::span<const float> noise,
+                                  std::int16_t *out) {
+    convert_kernels().to_int16_dither(in.data(), noise.data(), out,
+                                      in.size());
+}
+
+#endif
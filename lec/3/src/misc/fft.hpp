@@ -1,40 +1,338 @@
+#ifndef APP_FFT_H
+#define APP_FFT_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <complex>
-#include <math.h>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
-const double PI = acos(-1);
+#include "Trace.hpp"
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
-static void fft2(std::vector<std::complex<float>> &a, bool invert) {
-    using cd = std::complex<float>;
-    int n = a.size();
+// in-place power-of-two FFT with precomputed bit reversal and twiddles.
+// plans are immutable, so one plan can be shared between threads. the
+// forward transform uses exp(+2 pi i k n / N), the inverse one is scaled
+// by 1 / N.
+struct FftPlan {
+    FftPlan(size_t n) : n(n), forward(n), inverse(n) {
+        if (n == 0 || (n & (n - 1)) != 0) {
+            throw std::invalid_argument("fft size must be a power of two");
+        }
 
-    for (int i = 1, j = 0; i < n; i++) {
-        int bit = n >> 1;
-        for (; j & bit; bit >>= 1)
+        for (size_t i = 1, j = 0; i < n; i++) {
+            size_t bit = n >> 1;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
             j ^= bit;
-        j ^= bit;
 
-        if (i < j)
-            swap(a[i], a[j]);
+            if (i < j) {
+                swaps.emplace_back(i, j);
+            }
+        }
+
+        // twiddles of the stage with half-size h live at [h, 2h)
+        for (size_t half = 1; half < n; half <<= 1) {
+            for (size_t j = 0; j < half; j++) {
+                double ang = M_PI * (double)j / (double)half;
+                forward[half + j] = {(float)std::cos(ang), (float)std::sin(ang)};
+                inverse[half + j] = std::conj(forward[half + j]);
+            }
+        }
+    }
+
+    // shared plan for the size, created on first use
+    static std::shared_ptr<const FftPlan> get(size_t n) {
+        static std::mutex mutex;
+        static std::unordered_map<size_t, std::shared_ptr<const FftPlan>>
+            plans;
+
+        std::lock_guard lock(mutex);
+        auto &plan = plans[n];
+        if (!plan) {
+            plan = std::make_shared<const FftPlan>(n);
+        }
+        return plan;
+    }
+
+    size_t size() const noexcept {
+        return n;
     }
 
-    for (int len = 2; len <= n; len <<= 1) {
-        double ang = 2 * PI / len * (invert ? -1 : 1);
-        cd wlen(cos(ang), sin(ang));
-        for (int i = 0; i < n; i += len) {
-            cd w(1);
-            for (int j = 0; j < len / 2; j++) {
-                cd u = a[i + j], v = a[i + j + len / 2] * w;
-                a[i + j] = u + v;
-                a[i + j + len / 2] = u - v;
-                w *= wlen;
+    void execute(std::span<std::complex<float>> a, bool invert) const {
+        assert(a.size() == n);
+        TraceScope trace("fft", "dsp", "n", n);
+
+        for (auto [i, j] : swaps) {
+            std::swap(a[i], a[j]);
+        }
+
+        auto tw = invert ? inverse.data() : forward.data();
+
+        size_t half = 1;
+        if (n >= 4) {
+            first_radix4(a, invert);
+            half = 4;
+        }
+
+        for (; half * 2 < n; half *= 4) {
+            radix4(a, tw, half);
+        }
+
+        if (half < n) {
+            radix2(a, tw, half);
+        }
+
+        if (invert) {
+            float scale = 1.f / (float)n;
+            for (auto &x : a) {
+                x *= scale;
             }
         }
     }
 
-    if (invert) {
-        for (cd &x : a)
-            x /= n;
+  private:
+    using cf = std::complex<float>;
+
+    static cf cmul(cf v, cf w) {
+        return {v.real() * w.real() - v.imag() * w.imag(),
+                v.imag() * w.real() + v.real() * w.imag()};
+    }
+
+    // the first two stages only need twiddles of 1 and +-i
+    void first_radix4(std::span<cf> a, bool invert) const {
+        for (size_t i = 0; i < n; i += 4) {
+            cf b0 = a[i] + a[i + 1];
+            cf b1 = a[i] - a[i + 1];
+            cf b2 = a[i + 2] + a[i + 3];
+            cf b3 = a[i + 2] - a[i + 3];
+            cf ib3 = invert ? cf(b3.imag(), -b3.real())
+                            : cf(-b3.imag(), b3.real());
+            a[i] = b0 + b2;
+            a[i + 2] = b0 - b2;
+            a[i + 1] = b1 + ib3;
+            a[i + 3] = b1 - ib3;
+        }
+    }
+
+#ifdef __SSE2__
+    static __m128 cmul2(__m128 v, __m128 w) {
+        const __m128 sign = _mm_set_ps(0.f, -0.f, 0.f, -0.f);
+        __m128 wr = _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 wi = _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 1, 1));
+        __m128 vs = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        return _mm_add_ps(_mm_mul_ps(v, wr),
+                          _mm_xor_ps(_mm_mul_ps(vs, wi), sign));
+    }
+#endif
+
+    // two radix-2 stages (half-sizes h and 2h) fused into one pass
+    static void radix4(std::span<cf> a, const cf *tw, size_t h) {
+        size_t n = a.size();
+        for (size_t i = 0; i < n; i += 4 * h) {
+            cf *p = a.data() + i;
+#ifdef __SSE2__
+            for (size_t j = 0; j < h; j += 2) {
+                auto wa = _mm_loadu_ps((const float *)(tw + h + j));
+                auto wb0 = _mm_loadu_ps((const float *)(tw + 2 * h + j));
+                auto wb1 = _mm_loadu_ps((const float *)(tw + 3 * h + j));
+
+                auto a0 = _mm_loadu_ps((float *)(p + j));
+                auto a1 = cmul2(_mm_loadu_ps((float *)(p + j + h)), wa);
+                auto a2 = _mm_loadu_ps((float *)(p + j + 2 * h));
+                auto a3 = cmul2(_mm_loadu_ps((float *)(p + j + 3 * h)), wa);
+
+                auto x0 = _mm_add_ps(a0, a1);
+                auto x1 = _mm_sub_ps(a0, a1);
+                auto x2 = cmul2(_mm_add_ps(a2, a3), wb0);
+                auto x3 = cmul2(_mm_sub_ps(a2, a3), wb1);
+
+                _mm_storeu_ps((float *)(p + j), _mm_add_ps(x0, x2));
+                _mm_storeu_ps((float *)(p + j + 2 * h), _mm_sub_ps(x0, x2));
+                _mm_storeu_ps((float *)(p + j + h), _mm_add_ps(x1, x3));
+                _mm_storeu_ps((float *)(p + j + 3 * h), _mm_sub_ps(x1, x3));
+            }
+#else
+            for (size_t j = 0; j < h; j++) {
+                cf a1 = cmul(p[j + h], tw[h + j]);
+                cf a3 = cmul(p[j + 3 * h], tw[h + j]);
+                cf x0 = p[j] + a1;
+                cf x1 = p[j] - a1;
+                cf x2 = cmul(p[j + 2 * h] + a3, tw[2 * h + j]);
+                cf x3 = cmul(p[j + 2 * h] - a3, tw[3 * h + j]);
+                p[j] = x0 + x2;
+                p[j + 2 * h] = x0 - x2;
+                p[j + h] = x1 + x3;
+                p[j + 3 * h] = x1 - x3;
+            }
+#endif
+        }
     }
-}
\ No newline at end of file
+
+    static void radix2(std::span<cf> a, const cf *tw, size_t h) {
+        size_t n = a.size();
+        for (size_t i = 0; i < n; i += 2 * h) {
+            cf *p = a.data() + i;
+            size_t j = 0;
+#ifdef __SSE2__
+            for (; j + 2 <= h; j += 2) {
+                auto w = _mm_loadu_ps((const float *)(tw + h + j));
+                auto u = _mm_loadu_ps((float *)(p + j));
+                auto v = cmul2(_mm_loadu_ps((float *)(p + j + h)), w);
+                _mm_storeu_ps((float *)(p + j), _mm_add_ps(u, v));
+                _mm_storeu_ps((float *)(p + j + h), _mm_sub_ps(u, v));
+            }
+#endif
+            for (; j < h; j++) {
+                cf u = p[j];
+                cf v = cmul(p[j + h], tw[h + j]);
+                p[j] = u + v;
+                p[j + h] = u - v;
+            }
+        }
+    }
+
+    size_t n;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> swaps;
+    std::vector<std::complex<float>> forward;
+    std::vector<std::complex<float>> inverse;
+};
+
+// transforms of real signals of power-of-two size n, giving the bins from 0
+// to n / 2 (the others are their conjugates), with the conventions of
+// FftPlan. both directions work in place on n / 2 + 1 complex values, the
+// signal taking the n floats of the first n / 2 of them (see samples()),
+// and cost one complex transform of size n / 2.
+struct RealFftPlan {
+    RealFftPlan(size_t n)
+        : n(n), half(FftPlan::get(n / 2)), full(FftPlan::get(n)),
+          twiddles(n / 4 + 1) {
+        for (size_t k = 0; k < twiddles.size(); k++) {
+            double ang = 2. * M_PI * (double)k / (double)n;
+            twiddles[k] = {(float)std::cos(ang), (float)std::sin(ang)};
+        }
+    }
+
+    // shared plan for the size, created on first use
+    static std::shared_ptr<const RealFftPlan> get(size_t n) {
+        static std::mutex mutex;
+        static std::unordered_map<size_t, std::shared_ptr<const RealFftPlan>>
+            plans;
+
+        std::lock_guard lock(mutex);
+        auto &plan = plans[n];
+        if (!plan) {
+            plan = std::make_shared<const RealFftPlan>(n);
+        }
+        return plan;
+    }
+
+    size_t size() const noexcept {
+        return n;
+    }
+
+    // the real signal stored in a buffer of bins
+    static std::span<float> samples(std::span<std::complex<float>> a) {
+        return std::span(reinterpret_cast<float *>(a.data()), 2 * a.size());
+    }
+
+    // samples (x[2m] + i x[2m + 1] as complex values) to bins. the halves
+    // transform of the even and odd samples are split apart and joined with
+    // one more butterfly, bins k and n / 2 - k at a time.
+    void forward(std::span<std::complex<float>> a) const {
+        size_t h = n / 2;
+        assert(a.size() == h + 1);
+        TraceScope trace("rfft", "dsp", "n", n);
+
+        half->execute(a.subspan(0, h), false);
+
+        auto z = a[0];
+        a[0] = z.real() + z.imag();
+        a[h] = z.real() - z.imag();
+
+        for (size_t k = 1; k <= h / 2; k++) {
+            auto zk = a[k];
+            auto zm = std::conj(a[h - k]);
+            auto even = (zk + zm) * 0.5f;
+            auto odd = (zk - zm) * cf(0.f, -0.5f) * twiddles[k];
+            a[k] = even + odd;
+            a[h - k] = std::conj(even - odd);
+        }
+    }
+
+    // bins to samples, scaled by 1 / n. only the real parts of bins 0 and
+    // n / 2 are used, like a complex inverse of the conjugate-symmetric
+    // spectrum would if only its real part is kept.
+    void inverse(std::span<std::complex<float>> a) const {
+        size_t h = n / 2;
+        assert(a.size() == h + 1);
+        TraceScope trace("rfft", "dsp", "n", n);
+
+        float x0 = a[0].real();
+        float xh = a[h].real();
+        a[0] = {(x0 + xh) * 0.5f, (x0 - xh) * 0.5f};
+
+        for (size_t k = 1; k <= h / 2; k++) {
+            auto xk = a[k];
+            auto xm = std::conj(a[h - k]);
+            auto even = (xk + xm) * 0.5f;
+            auto odd = (xk - xm) * 0.5f * std::conj(twiddles[k]);
+            a[k] = even + cf(-odd.imag(), odd.real());
+            a[h - k] = std::conj(even) + cf(odd.imag(), odd.real());
+        }
+
+        half->execute(a.subspan(0, h), true);
+    }
+
+    // "two for one": transforms two real signals x and y with one complex
+    // transform of size n. a holds n + 2 values, a[m] = x[m] + i y[m] for
+    // m < n, and gets the bins of x followed by the bins of y.
+    void forward2(std::span<std::complex<float>> a) const {
+        size_t h = n / 2;
+        assert(a.size() == n + 2);
+        TraceScope trace("rfft2", "dsp", "n", n);
+
+        full->execute(a.subspan(0, n), false);
+
+        // the bins of y are first written backwards from a[n + 1] down to
+        // a[h + 1], each into a value already split
+        auto z = a[0];
+        a[0] = z.real();
+        a[n + 1] = z.imag();
+
+        for (size_t k = 1; k < h; k++) {
+            auto zk = a[k];
+            auto zm = std::conj(a[n - k]);
+            a[k] = (zk + zm) * 0.5f;
+            a[n + 1 - k] = (zk - zm) * cf(0.f, -0.5f);
+        }
+
+        z = a[h];
+        a[h] = z.real();
+        a[h + 1] = z.imag();
+
+        std::reverse(a.begin() + h + 1, a.end());
+    }
+
+  private:
+    using cf = std::complex<float>;
+
+    size_t n;
+    std::shared_ptr<const FftPlan> half;
+    std::shared_ptr<const FftPlan> full;
+    // exp(2 pi i k / n) for k up to n / 4
+    std::vector<std::complex<float>> twiddles;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef APP_SIMD_H
+#define APP_SIMD_H
+
+#include <cstddef>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+// small vector kernels shared by the dsp code. inputs don't have to be
+// aligned.
+
+// sum of a[i] * b[i]
+static float simd_dot(const float *a, const float *b, size_t n) noexcept {
+    size_t i = 0;
+    float sum = 0.f;
+#ifdef __SSE2__
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(
+            acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                           _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// y[i] += a * x[i]
+static void simd_axpy(float a, const float *x, float *y, size_t n) noexcept {
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128 va = _mm_set1_ps(a);
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i),
+                                        _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+    }
+#endif
+    for (; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+// y[i] *= x[i]
+static void simd_mul(const float *x, float *y, size_t n) noexcept {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(y + i,
+                      _mm_mul_ps(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+    }
+#endif
+    for (; i < n; i++) {
+        y[i] *= x[i];
+    }
+}
+
+// y[i] *= a
+static void simd_scale(float a, float *y, size_t n) noexcept {
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128 va = _mm_set1_ps(a);
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(y + i, _mm_mul_ps(_mm_loadu_ps(y + i), va));
+    }
+#endif
+    for (; i < n; i++) {
+        y[i] *= a;
+    }
+}
+
+// y[i] += a[i] * b[i] for complex values kept as separate real and
+// imaginary arrays
+static void simd_cmac(const float *ar, const float *ai, const float *br,
+                      const float *bi, float *yr, float *yi,
+                      size_t n) noexcept {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4) {
+        __m128 xr = _mm_loadu_ps(ar + i);
+        __m128 xi = _mm_loadu_ps(ai + i);
+        __m128 hr = _mm_loadu_ps(br + i);
+        __m128 hi = _mm_loadu_ps(bi + i);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi));
+        __m128 im = _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr));
+        _mm_storeu_ps(yr + i, _mm_add_ps(_mm_loadu_ps(yr + i), re));
+        _mm_storeu_ps(yi + i, _mm_add_ps(_mm_loadu_ps(yi + i), im));
+    }
+#endif
+    for (; i < n; i++) {
+        yr[i] += ar[i] * br[i] - ai[i] * bi[i];
+        yi[i] += ar[i] * bi[i] + ai[i] * br[i];
+    }
+}
+
+#endif
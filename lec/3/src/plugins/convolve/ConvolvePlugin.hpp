@@ -0,0 +1,64 @@
+#ifndef APP_CONVOLVE_PLUGIN_H
+#define APP_CONVOLVE_PLUGIN_H
+
+#include "../../App.hpp"
+#include "ConvolveStream.hpp"
+
+#include <stdexcept>
+
+// samples per partition of the response, which is also the latency of the
+// convolution
+const size_t CONVOLVE_BLOCK = 1024;
+
+struct ConvolveStep : public Step {
+    ConvolveStep(SlotRef response) : response(response) {
+    }
+
+    bool heavy() const override {
+        return true;
+    }
+
+    void apply(State &state) const override {
+        auto b = state.share(response);
+        if (b.length() == 0) {
+            throw std::runtime_error("impulse response is empty");
+        }
+        auto a = std::move(state.slots[0]);
+        state.slots[0] =
+            box_stream<ConvolveStream<StreamBox<float>, StreamBox<float>>>(
+                std::move(a), std::move(b), CONVOLVE_BLOCK);
+    }
+
+    SlotRef response;
+};
+
+struct ConvolveCommand : public Command {
+    std::string name() const override {
+        return "convolve";
+    }
+
+    std::string help() const override {
+        return ("    convolve $<slot id>\n"
+                "    convolves the main track with the impulse response in "
+                "the slot,\n"
+                "    e.g. of a room for reverb. the track gets longer by the "
+                "length of\n"
+                "    the response.");
+    }
+
+    std::unique_ptr<Step> parse(Context &ctx) const override {
+        auto response = read_slot_ref(ctx);
+
+        skip_idents(ctx);
+
+        return std::make_unique<ConvolveStep>(response);
+    }
+};
+
+struct ConvolvePlugin : public Plugin {
+    void register_at(App &app) const override {
+        app.register_command(std::move(ConvolveCommand()));
+    }
+};
+
+#endif
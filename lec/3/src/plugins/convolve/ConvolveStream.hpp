@@ -0,0 +1,219 @@
+#ifndef APP_CONVOLVE_STREAM_H
+#define APP_CONVOLVE_STREAM_H
+
+#include <algorithm>
+#include <complex>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "../../misc/Trace.hpp"
+#include "../../misc/fft.hpp"
+#include "../../misc/simd.hpp"
+#include "../../streams/Stream.hpp"
+
+// impulse response cut into partitions of `block` samples, each one zero
+// padded to 2 * block and transformed once. bins are kept as separate real
+// and imaginary arrays, partition after partition. the response is in the
+// int16 scale of the tracks, so a full-scale sample is a gain of 1.
+struct PartitionedFilter {
+    PartitionedFilter(const std::vector<float> &response, size_t block)
+        : block(block), length(response.size()),
+          partitions((response.size() + block - 1) / block),
+          re(partitions * (block + 1)), im(partitions * (block + 1)) {
+        auto fft = RealFftPlan::get(2 * block);
+        std::vector<std::complex<float>> bins(block + 1);
+        auto samples = RealFftPlan::samples(bins);
+
+        for (size_t p = 0; p < partitions; p++) {
+            size_t from = p * block;
+            size_t n = std::min(block, length - from);
+            std::fill(samples.begin(), samples.end(), 0.f);
+            for (size_t i = 0; i < n; i++) {
+                samples[i] = response[from + i] / 32768.f;
+            }
+            fft->forward(bins);
+
+            for (size_t k = 0; k <= block; k++) {
+                re[p * (block + 1) + k] = bins[k].real();
+                im[p * (block + 1) + k] = bins[k].imag();
+            }
+        }
+    }
+
+    size_t block;
+    // samples of the response
+    size_t length;
+    size_t partitions;
+    std::vector<float> re;
+    std::vector<float> im;
+};
+
+// convolves `a` with the impulse response `b` by uniformly partitioned
+// overlap-save: every block of input is transformed once and kept in a
+// frequency-domain delay line, and a block of output is the inverse of the
+// sum of the last `partitions` input spectra times the partition spectra.
+// a block costs the same however far the response reaches, and output lags
+// input by one block.
+//
+// `b` is read whole on the first read. the output is the full convolution,
+// longer than `a` by the length of the response minus one.
+template <IsStream<float> A, IsStream<float> B>
+class ConvolveStream : public Stream<float> {
+  public:
+    ConvolveStream(A &&a, B &&b, size_t block)
+        : a(std::move(a)), b(std::move(b)), block(block), head(0),
+          window(2 * block), bins(block + 1), output(block), remaining(0),
+          input_length(0), input_ended(false), emitted(0),
+          fft(RealFftPlan::get(2 * block)) {
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        if (!filter) {
+            load();
+        }
+
+        size_t total = input_length + filter->length - 1;
+        if (input_ended && emitted >= total) {
+            return std::nullopt;
+        }
+
+        if (remaining == 0) {
+            process_block();
+            remaining = block;
+            total = input_length + filter->length - 1;
+        }
+
+        size_t feed = std::min(out.size(), remaining);
+        if (input_ended) {
+            feed = std::min(feed, total - emitted);
+        }
+
+        std::memcpy(out.data(), output.data() + block - remaining,
+                    feed * sizeof(float));
+        remaining -= feed;
+        emitted += feed;
+
+        return std::make_optional(feed);
+    }
+
+    std::optional<size_t> length() const override {
+        auto la = a.length();
+        std::optional<size_t> lb;
+        if (filter) {
+            lb = filter->length;
+        } else {
+            lb = b.length();
+        }
+        // an empty response has no length, loading it fails
+        if (!la.has_value() || !lb.has_value() || *lb == 0) {
+            return std::nullopt;
+        }
+        return std::make_optional(*la + *lb - 1);
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<ConvolveStream<A, B>>(*this);
+    }
+
+  private:
+    void load() {
+        TraceScope trace("load response", "dsp");
+
+        std::vector<float> response;
+        size_t r = 0;
+        do {
+            size_t at = response.size();
+            response.resize(at + LOAD_BLOCK);
+            r = b.read_full(std::span(response.data() + at, LOAD_BLOCK));
+            response.resize(at + r);
+        } while (r == LOAD_BLOCK);
+
+        if (response.empty()) {
+            throw std::runtime_error("impulse response is empty");
+        }
+
+        filter = std::make_shared<const PartitionedFilter>(response, block);
+        re.assign(filter->re.size(), 0.f);
+        im.assign(filter->im.size(), 0.f);
+        sum_re.resize(block + 1);
+        sum_im.resize(block + 1);
+    }
+
+    void process_block() {
+        TraceScope trace("convolve", "dsp", "n", block);
+
+        // the window holds the previous block of input and the new one
+        std::memcpy(window.data(), window.data() + block,
+                    block * sizeof(float));
+        auto fresh = std::span(window.data() + block, block);
+        size_t r = input_ended ? 0 : a.read_full(fresh);
+        std::fill(fresh.begin() + r, fresh.end(), 0.f);
+        input_length += r;
+        input_ended = input_ended || r < block;
+
+        auto samples = RealFftPlan::samples(bins);
+        std::copy(window.begin(), window.end(), samples.begin());
+        fft->forward(bins);
+
+        size_t stride = block + 1;
+        head = head == 0 ? filter->partitions - 1 : head - 1;
+        for (size_t k = 0; k < stride; k++) {
+            re[head * stride + k] = bins[k].real();
+            im[head * stride + k] = bins[k].imag();
+        }
+
+        // input spectra from the newest, the delay line being a ring
+        // starting at `head`
+        std::fill(sum_re.begin(), sum_re.end(), 0.f);
+        std::fill(sum_im.begin(), sum_im.end(), 0.f);
+        for (size_t p = 0; p < filter->partitions; p++) {
+            size_t x = (head + p) % filter->partitions * stride;
+            size_t h = p * stride;
+            simd_cmac(re.data() + x, im.data() + x, filter->re.data() + h,
+                      filter->im.data() + h, sum_re.data(), sum_im.data(),
+                      stride);
+        }
+
+        for (size_t k = 0; k < stride; k++) {
+            bins[k] = {sum_re[k], sum_im[k]};
+        }
+        fft->inverse(bins);
+
+        // the first half wrapped around, the second one is the output
+        std::copy(samples.begin() + block, samples.begin() + 2 * block,
+                  output.begin());
+    }
+
+    A a;
+    B b;
+    size_t block;
+    std::shared_ptr<const PartitionedFilter> filter;
+
+    // frequency-domain delay line of the input spectra
+    std::vector<float> re;
+    std::vector<float> im;
+    size_t head;
+
+    std::vector<float> window;
+    std::vector<std::complex<float>> bins;
+    std::vector<float> sum_re;
+    std::vector<float> sum_im;
+
+    // last block of output, of which `remaining` samples weren't read yet
+    std::vector<float> output;
+    size_t remaining;
+
+    size_t input_length;
+    bool input_ended;
+    size_t emitted;
+
+    std::shared_ptr<const RealFftPlan> fft;
+
+    static constexpr size_t LOAD_BLOCK = 44100;
+};
+
+#endif
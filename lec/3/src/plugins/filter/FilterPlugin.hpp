@@ -0,0 +1,114 @@
+#ifndef APP_FILTER_PLUGIN_H
+#define APP_FILTER_PLUGIN_H
+
+#include "../../App.hpp"
+#include "../../pointwise.hpp"
+#include "FilterStream.hpp"
+
+#include <vector>
+
+// runs a cascade of biquads. consecutive filters are merged into one
+// cascade, so a chain of them fills the vector lanes of a single kernel.
+struct FilterStep : public Step {
+    FilterStep(std::vector<Biquad> sections) : sections(std::move(sections)) {
+    }
+
+    void apply(State &state) const override {
+        fuse(state.slots[0], BiquadKernel(sections));
+    }
+
+    bool noop() const override {
+        return sections.empty();
+    }
+
+    std::unique_ptr<Step> merge(const Step &next) const override {
+        auto other = dynamic_cast<const FilterStep *>(&next);
+        if (other == nullptr) {
+            return nullptr;
+        }
+        auto merged = sections;
+        merged.insert(merged.end(), other->sections.begin(),
+                      other->sections.end());
+        return std::make_unique<FilterStep>(std::move(merged));
+    }
+
+    std::vector<Biquad> sections;
+};
+
+struct FilterCommand : public Command {
+    std::string name() const override {
+        return "filter";
+    }
+
+    std::string help() const override {
+        return ("    filter lowpass|highpass <freq> [q <q>]\n"
+                "    filter peak|lowshelf|highshelf <freq> <gain> [q <q>]\n"
+                "    filters the main track, <freq> is in Hz and <gain> in "
+                "dB. q defaults\n"
+                "    to 0.707.");
+    }
+
+    std::unique_ptr<Step> parse(Context &ctx) const override {
+        auto type_at = ctx.position;
+        auto type = read_word(ctx, "filter type");
+        bool has_gain = type == "peak" || type == "lowshelf" ||
+                        type == "highshelf";
+        if (!has_gain && type != "lowpass" && type != "highpass") {
+            throw ConfigError(type_at, ctx.position,
+                              "filter type must be lowpass, highpass, peak, "
+                              "lowshelf or highshelf");
+        }
+
+        skip_idents(ctx);
+
+        auto freq_at = ctx.position;
+        auto freq = read_decimal<double>(ctx);
+        if (freq <= 0. || freq >= 22050.) {
+            throw ConfigError(freq_at, ctx.position,
+                              "frequency must be between 0 and 22050 Hz");
+        }
+
+        skip_idents(ctx);
+
+        double gain = 0.;
+        if (has_gain) {
+            gain = read_decimal<double>(ctx);
+            skip_idents(ctx);
+        }
+
+        double q = 0.707;
+        if (!is_eol(*ctx) && *ctx != '#') {
+            skip_word(ctx, "q");
+            skip_idents(ctx);
+            auto q_at = ctx.position;
+            q = read_decimal<double>(ctx);
+            if (q <= 0.) {
+                throw ConfigError(q_at, ctx.position, "q must be positive");
+            }
+            skip_idents(ctx);
+        }
+
+        Biquad section;
+        if (type == "lowpass") {
+            section = Biquad::lowpass(freq, q);
+        } else if (type == "highpass") {
+            section = Biquad::highpass(freq, q);
+        } else if (type == "peak") {
+            section = Biquad::peak(freq, gain, q);
+        } else if (type == "lowshelf") {
+            section = Biquad::low_shelf(freq, gain, q);
+        } else {
+            section = Biquad::high_shelf(freq, gain, q);
+        }
+
+        return std::make_unique<FilterStep>(std::vector{section});
+    }
+};
+
+struct FilterPlugin : public Plugin {
+    void register_at(App &app) const override {
+        app.register_command(std::move(FilterCommand()));
+    }
+};
+
+#endif
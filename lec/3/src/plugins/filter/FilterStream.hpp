@@ -0,0 +1,261 @@
+#ifndef APP_FILTER_STREAM_H
+#define APP_FILTER_STREAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "../../streams/Stream.hpp"
+#include "../../streams/WavStream.hpp"
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+// coefficients of one second-order section, normalized so a0 is 1. the
+// designs are the ones of the audio eq cookbook (r. bristow-johnson) at
+// SAMPLE_RATE, `gain` is in dB.
+struct Biquad {
+    float b0 = 1.f;
+    float b1 = 0.f;
+    float b2 = 0.f;
+    float a1 = 0.f;
+    float a2 = 0.f;
+
+    static Biquad lowpass(double freq, double q) {
+        auto [c, alpha] = angle(freq, q);
+        return normalized((1. - c) / 2., 1. - c, (1. - c) / 2., 1. + alpha,
+                          -2. * c, 1. - alpha);
+    }
+
+    static Biquad highpass(double freq, double q) {
+        auto [c, alpha] = angle(freq, q);
+        return normalized((1. + c) / 2., -(1. + c), (1. + c) / 2., 1. + alpha,
+                          -2. * c, 1. - alpha);
+    }
+
+    static Biquad peak(double freq, double gain, double q) {
+        auto [c, alpha] = angle(freq, q);
+        double a = std::pow(10., gain / 40.);
+        return normalized(1. + alpha * a, -2. * c, 1. - alpha * a,
+                          1. + alpha / a, -2. * c, 1. - alpha / a);
+    }
+
+    static Biquad low_shelf(double freq, double gain, double q) {
+        auto [c, alpha] = angle(freq, q);
+        double a = std::pow(10., gain / 40.);
+        double s = 2. * std::sqrt(a) * alpha;
+        return normalized(a * ((a + 1.) - (a - 1.) * c + s),
+                          2. * a * ((a - 1.) - (a + 1.) * c),
+                          a * ((a + 1.) - (a - 1.) * c - s),
+                          (a + 1.) + (a - 1.) * c + s,
+                          -2. * ((a - 1.) + (a + 1.) * c),
+                          (a + 1.) + (a - 1.) * c - s);
+    }
+
+    static Biquad high_shelf(double freq, double gain, double q) {
+        auto [c, alpha] = angle(freq, q);
+        double a = std::pow(10., gain / 40.);
+        double s = 2. * std::sqrt(a) * alpha;
+        return normalized(a * ((a + 1.) + (a - 1.) * c + s),
+                          -2. * a * ((a - 1.) + (a + 1.) * c),
+                          a * ((a + 1.) + (a - 1.) * c - s),
+                          (a + 1.) - (a - 1.) * c + s,
+                          2. * ((a - 1.) - (a + 1.) * c),
+                          (a + 1.) - (a - 1.) * c - s);
+    }
+
+  private:
+    // cosine of the angular frequency and the alpha of the cookbook
+    static std::pair<double, double> angle(double freq, double q) {
+        double w = 2. * M_PI * freq / SAMPLE_RATE;
+        return {std::cos(w), std::sin(w) / (2. * q)};
+    }
+
+    static Biquad normalized(double b0, double b1, double b2, double a0,
+                             double a1, double a2) {
+        return Biquad{.b0 = (float)(b0 / a0),
+                      .b1 = (float)(b1 / a0),
+                      .b2 = (float)(b2 / a0),
+                      .a1 = (float)(a1 / a0),
+                      .a2 = (float)(a2 / a0)};
+    }
+};
+
+// cascade of biquads in transposed direct form II, also used as a stage of
+// FusedStream. sections go in groups of four, one per vector lane, padded
+// with pass-through ones. a group runs as a wavefront over the block: at
+// step t, lane k filters sample t - k with the output lane k - 1 gave one
+// step before, so all four sections advance in one vector operation.
+//
+// the state depends on everything before, so the stage can't seek.
+struct BiquadKernel {
+    BiquadKernel(const std::vector<Biquad> &sections)
+        : count(sections.size()), groups((sections.size() + 3) / 4) {
+        for (size_t i = 0; i < sections.size(); i++) {
+            auto &g = groups[i / 4];
+            size_t k = i % 4;
+            g.b0[k] = sections[i].b0;
+            g.b1[k] = sections[i].b1;
+            g.b2[k] = sections[i].b2;
+            g.a1[k] = sections[i].a1;
+            g.a2[k] = sections[i].a2;
+        }
+    }
+
+    void process(std::span<float> block, size_t, std::span<float>) {
+        for (auto &g : groups) {
+#ifdef __SSE2__
+            process_group(g, block);
+#else
+            size_t first = (&g - groups.data()) * 4;
+            for (size_t k = 0; k < 4 && first + k < count; k++) {
+                process_section(g, k, block);
+            }
+#endif
+            // decayed state is flushed before it turns denormal
+            for (size_t k = 0; k < 4; k++) {
+                if (std::abs(g.z1[k]) < 1e-10f &&
+                    std::abs(g.z2[k]) < 1e-10f) {
+                    g.z1[k] = 0.f;
+                    g.z2[k] = 0.f;
+                }
+            }
+        }
+    }
+
+    bool seek(size_t) {
+        return false;
+    }
+
+  private:
+    // four sections, one per lane. unused lanes pass samples through.
+    struct Group {
+        float b0[4] = {1.f, 1.f, 1.f, 1.f};
+        float b1[4] = {};
+        float b2[4] = {};
+        float a1[4] = {};
+        float a2[4] = {};
+        float z1[4] = {};
+        float z2[4] = {};
+    };
+
+#ifdef __SSE2__
+    static void process_group(Group &g, std::span<float> block) {
+        __m128 b0 = _mm_loadu_ps(g.b0);
+        __m128 b1 = _mm_loadu_ps(g.b1);
+        __m128 b2 = _mm_loadu_ps(g.b2);
+        __m128 a1 = _mm_loadu_ps(g.a1);
+        __m128 a2 = _mm_loadu_ps(g.a2);
+        __m128 z1 = _mm_loadu_ps(g.z1);
+        __m128 z2 = _mm_loadu_ps(g.z2);
+        __m128 y = _mm_setzero_ps();
+
+        size_t n = block.size();
+        float *data = block.data();
+
+        // one step of the wavefront. only lanes with a sample of the block
+        // update their state, which matters for the first three and last
+        // three steps.
+        auto step = [&](size_t t, bool edge) {
+            float x = t < n ? data[t] : 0.f;
+            __m128 in =
+                _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(y), 4));
+            in = _mm_move_ss(in, _mm_set_ss(x));
+
+            y = _mm_add_ps(_mm_mul_ps(b0, in), z1);
+            __m128 n1 = _mm_add_ps(
+                _mm_sub_ps(_mm_mul_ps(b1, in), _mm_mul_ps(a1, y)), z2);
+            __m128 n2 = _mm_sub_ps(_mm_mul_ps(b2, in), _mm_mul_ps(a2, y));
+
+            if (edge) {
+                __m128 active = _mm_castsi128_ps(_mm_set_epi32(
+                    lane_active(t, 3, n), lane_active(t, 2, n),
+                    lane_active(t, 1, n), lane_active(t, 0, n)));
+                n1 = _mm_or_ps(_mm_and_ps(active, n1),
+                               _mm_andnot_ps(active, z1));
+                n2 = _mm_or_ps(_mm_and_ps(active, n2),
+                               _mm_andnot_ps(active, z2));
+            }
+            z1 = n1;
+            z2 = n2;
+
+            if (t >= 3) {
+                data[t - 3] = _mm_cvtss_f32(
+                    _mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 3, 3)));
+            }
+        };
+
+        size_t t = 0;
+        for (; t < std::min<size_t>(3, n); t++) {
+            step(t, true);
+        }
+        for (; t < n; t++) {
+            step(t, false);
+        }
+        for (; t < n + 3; t++) {
+            step(t, true);
+        }
+
+        _mm_storeu_ps(g.z1, z1);
+        _mm_storeu_ps(g.z2, z2);
+    }
+
+    // all bits set if lane k has a sample of the block at step t
+    static int lane_active(size_t t, size_t k, size_t n) {
+        return t >= k && t - k < n ? -1 : 0;
+    }
+#else
+    static void process_section(Group &g, size_t k, std::span<float> block) {
+        float z1 = g.z1[k];
+        float z2 = g.z2[k];
+        for (auto &x : block) {
+            float y = g.b0[k] * x + z1;
+            z1 = g.b1[k] * x - g.a1[k] * y + z2;
+            z2 = g.b2[k] * x - g.a2[k] * y;
+            x = y;
+        }
+        g.z1[k] = z1;
+        g.z2[k] = z2;
+    }
+#endif
+
+    size_t count;
+    std::vector<Group> groups;
+};
+
+template <IsStream<float> S> class FilterStream : public Stream<float> {
+  public:
+    FilterStream(S &&stream, const std::vector<Biquad> &sections)
+        : stream(std::move(stream)), kernel(sections) {
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        auto r = stream.read(out);
+
+        if (!r.has_value()) {
+            return std::nullopt;
+        }
+
+        kernel.process(out.subspan(0, *r), 0, {});
+        return r;
+    }
+
+    std::optional<size_t> length() const override {
+        return stream.length();
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<FilterStream<S>>(*this);
+    }
+
+  private:
+    S stream;
+    BiquadKernel kernel;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef APP_GAIN_PLUGIN_H
+#define APP_GAIN_PLUGIN_H
+
+#include "../../App.hpp"
+#include "../../pointwise.hpp"
+#include "GainStream.hpp"
+
+struct GainStep : public Step {
+    GainStep(float gain) : gain(gain) {
+    }
+
+    void apply(State &state) const override {
+        fuse(state.slots[0], GainKernel{.gain = gain});
+    }
+
+    bool noop() const override {
+        return gain == 1.f;
+    }
+
+    float gain;
+};
+
+struct GainCommand : public Command {
+    std::string name() const override {
+        return "gain";
+    }
+
+    std::string help() const override {
+        return ("    gain <volume>% \n"
+                "    changes volume of the main track.");
+    }
+
+    std::unique_ptr<Step> parse(Context &ctx) const override {
+        auto volume = read_unsigned<size_t>(ctx);
+        skip_idents(ctx);
+        skip_word(ctx, "%");
+
+        return std::make_unique<GainStep>((float)volume / 100.f);
+    }
+};
+
+struct GainPlugin : public Plugin {
+    void register_at(App &app) const override {
+        app.register_command(std::move(GainCommand()));
+    }
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef APP_GAIN_STREAM_H
+#define APP_GAIN_STREAM_H
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "../../streams/Stream.hpp"
+
+// multiplies samples by a constant, also used as a stage of FusedStream
+struct GainKernel {
+    void process(std::span<float> block, size_t, std::span<float>) {
+        for (size_t i = 0; i < block.size(); i++) {
+            block[i] *= gain;
+        }
+    }
+
+    bool seek(size_t) {
+        return true;
+    }
+
+    float gain;
+};
+
+template <IsStream<float> S> class GainStream : public Stream<float> {
+  public:
+    GainStream(S &&stream, float gain)
+        : stream(std::move(stream)), kernel{.gain = gain} {
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        auto r = stream.read(out);
+
+        if (!r.has_value()) {
+            return std::nullopt;
+        }
+
+        kernel.process(out.subspan(0, *r), 0, {});
+        return r;
+    }
+
+    bool seek(size_t pos) override {
+        return stream.seek(pos);
+    }
+
+    std::optional<size_t> length() const override {
+        return stream.length();
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<GainStream<S>>(*this);
+    }
+
+  private:
+    S stream;
+    GainKernel kernel;
+};
+
+#endif
@@ -2,38 +2,81 @@
 #define APP_MIX_PLUGIN_H
 
 #include "../../App.hpp"
+#include "../../pointwise.hpp"
 #include "MixStream.hpp"
 
+#include <vector>
+
+// track referenced by a mix command
+struct MixSource {
+    SlotRef slot;
+    // in seconds of the main track
+    size_t insert_at = 0;
+    float gain = 1.f;
+};
+
+struct MixStep : public Step {
+    MixStep(std::vector<MixSource> sources) : sources(std::move(sources)) {
+    }
+
+    void apply(State &state) const override {
+        std::vector<MixInput<StreamBox<float>>> inputs;
+        for (auto &source : sources) {
+            inputs.push_back(MixInput<StreamBox<float>>{
+                .stream = state.share(source.slot),
+                .insert_at = source.insert_at * 44100,
+                .gain = source.gain,
+            });
+        }
+        fuse(state.slots[0], MixBusKernel<StreamBox<float>>(std::move(inputs)));
+    }
+
+    std::vector<MixSource> sources;
+};
+
 struct MixCommand : public Command {
     std::string name() const override {
         return "mix";
     }
 
     std::string help() const override {
-        return ("      mix $<slot> \n"
-                "    or\n"
-                "      mix $<slot> <insert at>\n"
-                "    combines two tracks (the main one and the selected one) "
-                "into one.\n"
-                "    if <insert at> is provided, will start mixing at the "
-                "selected time.");
+        return ("      mix $<slot> [<insert at>] [<volume>%] "
+                "[$<slot> [<insert at>] [<volume>%]...]\n"
+                "    combines the main track and the selected ones into one.\n"
+                "    if <insert at> is provided, the track starts playing at "
+                "the selected time,\n"
+                "    <volume> scales it before mixing. every sample is the "
+                "average of the\n"
+                "    tracks playing at it.");
     }
 
-    void run(State &state) override {
-        auto mix_with = state.read_slot();
+    std::unique_ptr<Step> parse(Context &ctx) const override {
+        std::vector<MixSource> sources;
 
-        skip_idents(state.ctx);
+        do {
+            MixSource source{.slot = read_slot_ref(ctx)};
+            skip_idents(ctx);
 
-        size_t insert_at = 0;
-        if (!is_eol(*state.ctx)) {
-            insert_at = read_unsigned<size_t>(state.ctx);
-        }
+            if (is_digit(*ctx)) {
+                auto number = read_unsigned<size_t>(ctx);
+                if (*ctx != '%') {
+                    source.insert_at = number;
+                    skip_idents(ctx);
+                }
+                if (*ctx == '%' || is_digit(*ctx)) {
+                    if (*ctx != '%') {
+                        number = read_unsigned<size_t>(ctx);
+                    }
+                    skip_word(ctx, "%");
+                    source.gain = (float)number / 100.f;
+                    skip_idents(ctx);
+                }
+            }
+
+            sources.push_back(source);
+        } while (*ctx == '$');
 
-        auto a = state.slots[0];
-        auto b = state.slots[mix_with - 1];
-        auto m = box_stream<MixStream<StreamBox<float>, StreamBox<float>>>(
-            std::move(a), std::move(b), insert_at * 44100);
-        state.slots[0] = m;
+        return std::make_unique<MixStep>(std::move(sources));
     }
 };
 
@@ -43,4 +86,4 @@ struct MixPlugin : public Plugin {
     }
 };
 
-#endif
\ No newline at end of file
+#endif
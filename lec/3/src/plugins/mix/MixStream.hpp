@@ -1,55 +1,141 @@
 #ifndef APP_MIX_STREAM_H
 #define APP_MIX_STREAM_H
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <optional>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
+#include "../../misc/simd.hpp"
 #include "../../streams/Stream.hpp"
 
-template <IsStream<float> A, IsStream<float> B>
-class MixStream : public Stream<float> {
-  public:
-    MixStream(A &&a, B &&b, size_t insert_at = 0)
-        : a(std::move(a)), b(std::move(b)), b_buffer(44100), a_ended(false),
-          b_ended(false), insert_at_remaining(insert_at) {
+// track mixed into the main one, starting at sample `insert_at` of the main
+// track and scaled by `gain`
+template <IsStream<float> B> struct MixInput {
+    B stream;
+    size_t insert_at = 0;
+    float gain = 1.f;
+};
+
+// mixes any number of inputs into the block. every sample is divided by the
+// number of tracks playing at it, the main one included, so a single input
+// gives (a + b) / 2. inputs are read one after another into `scratch` and
+// added to the block, so a block can't be longer than the scratch buffer.
+// also used as a stage of FusedStream.
+template <IsStream<float> B> struct MixBusKernel {
+    MixBusKernel(std::vector<MixInput<B>> list) : position(0) {
+        for (auto &input : list) {
+            inputs.push_back(Input{std::move(input), false});
+        }
     }
 
-    std::optional<size_t> read(std::span<float> out) override {
-        if (insert_at_remaining != 0) {
-            auto r_max = std::min(insert_at_remaining, out.size());
-            auto r = a.read(std::span(out.begin(), r_max));
-            if (r.has_value()) {
-                insert_at_remaining -= *r;
+    void process(std::span<float> block, size_t offset,
+                 std::span<float> scratch) {
+        edges.clear();
+        for (auto &[input, ended] : inputs) {
+            if (ended || offset + block.size() <= input.insert_at) {
+                continue;
             }
-            return r;
-        }
 
-        if (a_ended) {
-            return std::nullopt;
+            size_t lo = std::max(offset, input.insert_at) - offset;
+            size_t n = block.size() - lo;
+            auto r = input.stream.read_full(scratch.subspan(0, n));
+            if (r < n) {
+                ended = true;
+            }
+            if (r != 0) {
+                simd_axpy(input.gain, scratch.data(), block.data() + lo, r);
+                edges.emplace_back(lo, 1);
+                edges.emplace_back(lo + r, -1);
+            }
         }
-
-        auto ar = a.read_full(out);
-        if (ar < out.size()) {
-            a_ended = true;
+        position = offset + block.size();
+
+        // every stretch between the edges of the inputs is divided by the
+        // number of tracks in it
+        std::sort(edges.begin(), edges.end());
+        int count = 1;
+        size_t from = 0;
+        for (auto [at, change] : edges) {
+            if (at > from && count > 1) {
+                simd_scale(1.f / (float)count, block.data() + from, at - from);
+            }
+            count += change;
+            from = at;
         }
+    }
 
-        if (b_ended) {
-            return std::make_optional(ar);
+    // moves every input to where it is at `pos` of the main track
+    bool seek(size_t pos) {
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if (!seek_input(inputs[i], pos)) {
+                for (size_t j = 0; j < i; j++) {
+                    seek_input(inputs[j], position);
+                }
+                return false;
+            }
         }
+        position = pos;
+        return true;
+    }
 
-        auto br = b.read_full(std::span(b_buffer.data(), ar));
-        if (br < ar) {
-            b_ended = true;
+  private:
+    struct Input {
+        MixInput<B> input;
+        bool ended;
+    };
+
+    static bool seek_input(Input &input, size_t pos) {
+        auto insert_at = input.input.insert_at;
+        if (!input.input.stream.seek(pos > insert_at ? pos - insert_at : 0)) {
+            return false;
         }
+        input.ended = false;
+        return true;
+    }
 
-        for (size_t i = 0; i < br; i++) {
-            out[i] = (out[i] + b_buffer[i]) * 0.5;
+    std::vector<Input> inputs;
+    // position in the main track after the last block
+    size_t position;
+    // where inputs start and stop within the current block
+    std::vector<std::pair<size_t, int>> edges;
+};
+
+template <IsStream<float> A, IsStream<float> B>
+class MixBusStream : public Stream<float> {
+  public:
+    MixBusStream(A &&a, std::vector<MixInput<B>> inputs)
+        : a(std::move(a)), kernel(std::move(inputs)), buffer(44100),
+          offset(0) {
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        auto block = out.subspan(0, std::min(out.size(), buffer.size()));
+
+        auto r = a.read(block);
+        if (!r.has_value()) {
+            return std::nullopt;
         }
 
-        return std::make_optional(ar);
+        kernel.process(block.subspan(0, *r), offset, buffer);
+
+        offset += *r;
+        return r;
+    }
+
+    bool seek(size_t pos) override {
+        if (!kernel.seek(pos)) {
+            return false;
+        }
+        if (!a.seek(pos)) {
+            kernel.seek(offset);
+            return false;
+        }
+        offset = pos;
+        return true;
     }
 
     std::optional<size_t> length() const override {
@@ -57,18 +143,14 @@ class MixStream : public Stream<float> {
     }
 
     StreamBox<float> clone() const override {
-        return box_stream<MixStream<A, B>>(*this);
+        return box_stream<MixBusStream<A, B>>(*this);
     }
 
   private:
     A a;
-    bool a_ended;
-
-    B b;
-    bool b_ended;
-    std::vector<float> b_buffer;
-
-    size_t insert_at_remaining;
+    MixBusKernel<B> kernel;
+    std::vector<float> buffer;
+    size_t offset;
 };
 
-#endif
\ No newline at end of file
+#endif
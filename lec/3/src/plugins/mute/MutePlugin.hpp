@@ -2,29 +2,200 @@
 #define APP_MUTE_PLUGIN_H
 
 #include "../../App.hpp"
+#include "../../pointwise.hpp"
+#include "../../streams/SilenceStream.hpp"
 #include "MuteStream.hpp"
 
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
+
+// mutes a set of ranges, kept sorted and without overlaps so merged steps
+// don't mute the same samples twice. steps are only merged where that
+// doesn't change the output.
+struct MuteStep : public Step {
+    MuteStep(std::vector<MuteRange> ranges) : ranges() {
+        for (auto &range : ranges) {
+            add(range);
+        }
+    }
+
+    void apply(State &state) const override {
+        auto &slot = state.slots[0];
+        if (slot.as<SilenceStream>() != nullptr) {
+            return;
+        }
+
+        // ranges past the end of the track are clipped or dropped, a range
+        // covering all of it replaces the track with silence
+        auto length = slot.length();
+        if (!length.has_value()) {
+            fuse(slot, MuteKernel(ranges));
+            return;
+        }
+
+        std::vector<MuteRange> clipped;
+        for (auto range : ranges) {
+            if (range.start == 0 && range.end >= *length) {
+                slot = box_stream<SilenceStream>(*length);
+                return;
+            }
+            if (range.start - std::min(range.start, range.before.length) >=
+                *length) {
+                break;
+            }
+            range.end = std::max(range.start, std::min(range.end, *length));
+            clipped.push_back(range);
+        }
+        if (!clipped.empty()) {
+            fuse(slot, MuteKernel(std::move(clipped)));
+        }
+    }
+
+    bool noop() const override {
+        return ranges.empty();
+    }
+
+    std::unique_ptr<Step> merge(const Step &next) const override {
+        auto other = dynamic_cast<const MuteStep *>(&next);
+        if (other == nullptr) {
+            return nullptr;
+        }
+        auto merged = std::make_unique<MuteStep>(ranges);
+        for (auto &range : other->ranges) {
+            merged->add(range);
+        }
+        if (!merged->exact({&ranges, &other->ranges})) {
+            return nullptr;
+        }
+        return merged;
+    }
+
+    std::vector<MuteRange> ranges;
+
+  private:
+    // inserts the range, joining it with the ones it overlaps or touches.
+    // the joined range fades like the range that starts first and the one
+    // that ends last.
+    void add(MuteRange range) {
+        if (range.start >= range.end) {
+            return;
+        }
+        auto first = std::lower_bound(
+            ranges.begin(), ranges.end(), range.start,
+            [](const MuteRange &r, size_t start) { return r.end < start; });
+        auto last = first;
+        while (last != ranges.end() && last->start <= range.end) {
+            if (last->start < range.start ||
+                (last->start == range.start &&
+                 last->before.length > range.before.length)) {
+                range.start = last->start;
+                range.before = last->before;
+            }
+            if (last->end > range.end ||
+                (last->end == range.end &&
+                 last->after.length > range.after.length)) {
+                range.end = last->end;
+                range.after = last->after;
+            }
+            last++;
+        }
+        first = ranges.erase(first, last);
+        ranges.insert(first, range);
+    }
+
+    // whether these ranges mute like each of the lists in turn. fades of
+    // separate steps multiply, so only one fade may reach out of a joined
+    // range on each side, and it must be the one the range kept. fades of
+    // neighbouring ranges must not meet, the kernel would shorten them.
+    bool exact(std::initializer_list<const std::vector<MuteRange> *> lists)
+        const {
+        for (size_t i = 0; i < ranges.size(); i++) {
+            auto &m = ranges[i];
+            if (i > 0 && ranges[i - 1].end + ranges[i - 1].after.length >
+                             m.start - std::min(m.start, m.before.length)) {
+                return false;
+            }
+
+            size_t before = 0;
+            size_t after = 0;
+            for (auto list : lists) {
+                for (auto &r : *list) {
+                    if (r.start >= r.end || r.start < m.start ||
+                        r.end > m.end) {
+                        continue;
+                    }
+                    if (r.before.length > r.start - m.start) {
+                        if (r.start != m.start) {
+                            return false;
+                        }
+                        before++;
+                    }
+                    if (r.after.length > m.end - r.end) {
+                        if (r.end != m.end) {
+                            return false;
+                        }
+                        after++;
+                    }
+                }
+            }
+            if (before > 1 || after > 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
 struct MuteCommand : public Command {
     std::string name() const override {
         return "mute";
     }
 
     std::string help() const override {
-        return ("    mute <start> <end> \n"
-                "    mutes the main track at selected time range.");
+        return ("    mute <start> <end> [fade <ms> [linear|cosine]]\n"
+                "    mutes the main track at selected time range.\n"
+                "    with fade, the track fades out for <ms> milliseconds "
+                "before the range\n"
+                "    and back in after it.");
     }
 
-    void run(State &state) override {
-        auto start = read_unsigned<size_t>(state.ctx);
+    std::unique_ptr<Step> parse(Context &ctx) const override {
+        auto start = read_unsigned<size_t>(ctx);
+
+        skip_idents(ctx);
+
+        auto end = read_unsigned<size_t>(ctx);
+
+        skip_idents(ctx);
 
-        skip_idents(state.ctx);
+        Fade fade;
+        if (!is_eol(*ctx) && *ctx != '#') {
+            skip_word(ctx, "fade");
+            skip_idents(ctx);
+            fade.length = read_unsigned<size_t>(ctx) * 44100 / 1000;
+            skip_idents(ctx);
 
-        auto end = read_unsigned<size_t>(state.ctx);
+            if (!is_eol(*ctx) && *ctx != '#') {
+                auto at = ctx.position;
+                auto shape = read_word(ctx, "fade shape");
+                if (shape == "linear") {
+                    fade.shape = FadeShape::linear;
+                } else if (shape == "cosine") {
+                    fade.shape = FadeShape::cosine;
+                } else {
+                    throw ConfigError(at, ctx.position,
+                                      "fade shape must be linear or cosine");
+                }
+            }
+        }
 
-        auto s = state.slots[0];
-        auto m = box_stream<MuteStream<StreamBox<float>>>(
-            std::move(s), start * 44100, end * 44100);
-        state.slots[0] = m;
+        return std::make_unique<MuteStep>(std::vector{MuteRange{
+            .start = start * 44100,
+            .end = end * 44100,
+            .before = fade,
+            .after = fade,
+        }});
     }
 };
 
@@ -34,4 +205,4 @@ struct MutePlugin : public Plugin {
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,19 +1,158 @@
 #ifndef APP_MUTE_STREAM_H
 #define APP_MUTE_STREAM_H
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <stdexcept>
 #include <vector>
 
+#include "../../misc/simd.hpp"
 #include "../../streams/Stream.hpp"
 
+enum class FadeShape { linear, cosine };
+
+struct Fade {
+    size_t length = 0;
+    FadeShape shape = FadeShape::linear;
+};
+
+// samples [start, end) are silent. the track fades out during the
+// `before.length` samples before the start and fades back in during the
+// `after.length` samples after the end.
+struct MuteRange {
+    size_t start;
+    size_t end;
+    Fade before = {};
+    Fade after = {};
+};
+
+// mutes a sorted list of ranges, also used as a stage of FusedStream. a
+// block is only touched where it meets a range: silent parts are zeroed and
+// fades are multiplied by a precomputed gain ramp.
+struct MuteKernel {
+    // ranges must be sorted and their silent parts must not overlap. fades
+    // running into a neighbouring range are shortened to the gap between
+    // them, where the two fades then multiply.
+    MuteKernel(std::vector<MuteRange> list) {
+        for (size_t i = 0; i < list.size(); i++) {
+            auto &range = list[i];
+            if (i > 0) {
+                range.before.length = std::min(range.before.length,
+                                               range.start - list[i - 1].end);
+            }
+            if (i + 1 < list.size()) {
+                range.after.length =
+                    std::min(range.after.length, list[i + 1].start - range.end);
+            }
+            ranges.push_back(Range{
+                .start = range.start,
+                .end = range.end,
+                .fade_out = ramp(range.before, false, range.start),
+                .fade_in = ramp(range.after, true, range.after.length),
+            });
+        }
+    }
+
+    void process(std::span<float> block, size_t offset, std::span<float>) {
+        size_t block_end = offset + block.size();
+
+        auto it = std::upper_bound(
+            ranges.begin(), ranges.end(), offset,
+            [](size_t pos, const Range &r) { return pos < r.zone_end(); });
+        for (; it != ranges.end() && it->zone_start() < block_end; it++) {
+            apply(block, offset, it->zone_start(), *it->fade_out);
+            fill(block, offset, it->start, it->end);
+            apply(block, offset, it->end, *it->fade_in);
+        }
+    }
+
+    bool seek(size_t) {
+        return true;
+    }
+
+    // end of the silence that `offset` falls into, or `offset` itself if it
+    // isn't muted. FusedStream uses this to skip reading muted input.
+    size_t silent_until(size_t offset) const {
+        auto it = std::upper_bound(
+            ranges.begin(), ranges.end(), offset,
+            [](size_t pos, const Range &r) { return pos < r.end; });
+        if (it != ranges.end() && it->start <= offset) {
+            return it->end;
+        }
+        return offset;
+    }
+
+  private:
+    struct Range {
+        size_t start;
+        size_t end;
+        std::shared_ptr<const std::vector<float>> fade_out;
+        std::shared_ptr<const std::vector<float>> fade_in;
+
+        size_t zone_start() const {
+            return start - fade_out->size();
+        }
+
+        size_t zone_end() const {
+            return end + fade_in->size();
+        }
+    };
+
+    // gains of the last `keep` samples of the fade in order, rising for a
+    // fade in. neither end reaches 0 or 1, those are the samples next to
+    // the fade. a fade out can start before the track does, then only its
+    // end is kept.
+    static std::shared_ptr<const std::vector<float>>
+    ramp(const Fade &fade, bool rising, size_t keep) {
+        size_t skip = fade.length - std::min(fade.length, keep);
+        auto gains = std::make_shared<std::vector<float>>(fade.length - skip);
+        for (size_t i = skip; i < fade.length; i++) {
+            double t = (double)(i + 1) / (double)(fade.length + 1);
+            if (!rising) {
+                t = 1. - t;
+            }
+            if (fade.shape == FadeShape::cosine) {
+                t = 0.5 - 0.5 * std::cos(M_PI * t);
+            }
+            (*gains)[i - skip] = (float)t;
+        }
+        return gains;
+    }
+
+    // zeroes the part of [from, to) inside the block
+    static void fill(std::span<float> block, size_t offset, size_t from,
+                     size_t to) {
+        size_t lo = std::clamp(from, offset, offset + block.size()) - offset;
+        size_t hi = std::clamp(to, offset, offset + block.size()) - offset;
+        if (lo < hi) {
+            std::memset(block.data() + lo, 0, (hi - lo) * sizeof(float));
+        }
+    }
+
+    // multiplies the block by the gains starting at sample `from`
+    static void apply(std::span<float> block, size_t offset, size_t from,
+                      const std::vector<float> &gains) {
+        size_t to = from + gains.size();
+        size_t lo = std::clamp(from, offset, offset + block.size());
+        size_t hi = std::clamp(to, offset, offset + block.size());
+        if (lo < hi) {
+            simd_mul(gains.data() + (lo - from), block.data() + (lo - offset),
+                     hi - lo);
+        }
+    }
+
+    std::vector<Range> ranges;
+};
+
 template <IsStream<float> S> class MuteStream : public Stream<float> {
   public:
-    MuteStream(S &&stream, size_t start, size_t end)
-        : stream(std::move(stream)), start(start), end(end), offset(0) {
+    MuteStream(S &&stream, std::vector<MuteRange> ranges)
+        : stream(std::move(stream)), kernel(std::move(ranges)), offset(0) {
     }
 
     std::optional<size_t> read(std::span<float> out) override {
@@ -23,16 +162,20 @@ template <IsStream<float> S> class MuteStream : public Stream<float> {
             return std::nullopt;
         }
 
-        for (size_t i = 0; i < *r; i++) {
-            if (offset + i >= start && offset + i < end) {
-                out[i] = 0.;
-            }
-        }
+        kernel.process(out.subspan(0, *r), offset, {});
 
         offset += *r;
         return r;
     }
 
+    bool seek(size_t pos) override {
+        if (!stream.seek(pos)) {
+            return false;
+        }
+        offset = pos;
+        return true;
+    }
+
     std::optional<size_t> length() const override {
         return stream.length();
     }
@@ -43,9 +186,8 @@ template <IsStream<float> S> class MuteStream : public Stream<float> {
 
   private:
     S stream;
-    size_t start;
-    size_t end;
+    MuteKernel kernel;
     size_t offset;
 };
 
-#endif
\ No newline at end of file
+#endif
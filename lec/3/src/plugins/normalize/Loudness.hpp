@@ -0,0 +1,356 @@
+#ifndef APP_LOUDNESS_H
+#define APP_LOUDNESS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../../misc/ThreadPool.hpp"
+#include "../../misc/Trace.hpp"
+#include "../../misc/util.hpp"
+#include "../../streams/Stream.hpp"
+#include "../../streams/TeeStream.hpp"
+
+// levels of a whole track, relative to full scale
+struct Loudness {
+    // largest sample
+    double peak = 0.;
+    // root mean square of the samples
+    double rms = 0.;
+    // integrated loudness in LUFS (itu-r bs.1770), -inf if every block is
+    // below the absolute gate
+    double lufs = -std::numeric_limits<double>::infinity();
+};
+
+// k-weighting of bs.1770 at 44100 Hz: a high shelf modelling the head and
+// a high pass. kept in double, the high pass is too close to dc for float.
+struct KWeighting {
+    KWeighting() {
+        double k = std::tan(M_PI * 1681.974450955533 / 44100.);
+        double q = 0.7071752369554196;
+        double vh = std::pow(10., 3.999843853973347 / 20.);
+        double vb = std::pow(vh, 0.4996667741545416);
+        double a0 = 1. + k / q + k * k;
+        shelf = {(vh + vb * k / q + k * k) / a0, 2. * (k * k - vh) / a0,
+                 (vh - vb * k / q + k * k) / a0, 2. * (k * k - 1.) / a0,
+                 (1. - k / q + k * k) / a0};
+
+        k = std::tan(M_PI * 38.13547087602444 / 44100.);
+        q = 0.5003270373238773;
+        a0 = 1. + k / q + k * k;
+        high_pass = {1., -2., 1., 2. * (k * k - 1.) / a0,
+                     (1. - k / q + k * k) / a0};
+    }
+
+    double operator()(double x) {
+        return high_pass(shelf(x));
+    }
+
+  private:
+    struct Section {
+        double b0, b1, b2, a1, a2;
+        double z1 = 0.;
+        double z2 = 0.;
+
+        double operator()(double x) {
+            double y = b0 * x + z1;
+            z1 = b1 * x - a1 * y + z2;
+            z2 = b2 * x - a2 * y;
+            return y;
+        }
+    };
+
+    Section shelf;
+    Section high_pass;
+};
+
+// measures the track in `source` without changing it. with a pool and a
+// seekable track of known length, chunks of it are measured at once on
+// clones seeking to their start, each one running the filters over a
+// second of audio before it first to settle them. otherwise one clone reads
+// the whole track.
+//
+// the clones are forked (ForkScope), so shared slots anywhere in the graph,
+// like the main one or one mixed in, are read from private copies of their
+// upstreams and nothing is buffered for their other readers. tracks read
+// from a pipe can't be read twice though: with `once` the source is shared
+// instead and measured by one more reader, which leaves the whole track
+// buffered until the render reads it.
+static Loudness measure_loudness(StreamBox<float> &source, ThreadPool *pool,
+                                 bool once) {
+    TraceScope trace("measure loudness", "dsp");
+
+    // the gating blocks are 400 ms long every 100 ms, so chunks keep the
+    // squares of every 100 ms and the blocks are summed from those
+    const size_t STEP = 4410;
+    const size_t CHUNK = 100 * STEP;
+    const size_t PREROLL = 44100;
+
+    struct Chunk {
+        double peak = 0.;
+        double squares = 0.;
+        size_t samples = 0;
+        std::vector<double> steps;
+    };
+
+    // reads `count` samples after `preroll` ones that only feed the filters
+    auto scan = [&](StreamBox<float> &stream, size_t preroll, size_t count) {
+        Chunk chunk;
+        KWeighting weighting;
+        std::vector<float> buffer(STEP);
+
+        while (preroll > 0) {
+            size_t r = stream.read_full(
+                std::span(buffer.data(), std::min(preroll, STEP)));
+            for (size_t i = 0; i < r; i++) {
+                weighting(buffer[i]);
+            }
+            if (r < std::min(preroll, STEP)) {
+                return chunk;
+            }
+            preroll -= r;
+        }
+
+        while (count > 0) {
+            size_t r = stream.read_full(
+                std::span(buffer.data(), std::min(count, STEP)));
+            double weighted = 0.;
+            for (size_t i = 0; i < r; i++) {
+                double x = buffer[i];
+                double w = weighting(x);
+                chunk.peak = std::max(chunk.peak, std::abs(x));
+                chunk.squares += x * x;
+                weighted += w * w;
+            }
+            chunk.samples += r;
+            if (r > 0) {
+                chunk.steps.push_back(weighted);
+            }
+            if (r < std::min(count, STEP)) {
+                break;
+            }
+            count -= r;
+        }
+        return chunk;
+    };
+
+    auto reader = [&]() {
+        if (once) {
+            if (source.as<TeeStream>() == nullptr) {
+                source = box_stream<TeeStream>(std::move(source));
+            }
+            return source.clone();
+        }
+        ForkScope scope;
+        return source.clone();
+    };
+
+    std::vector<Chunk> chunks;
+    auto length = source.length();
+    if (pool && !once && length.has_value() && *length > CHUNK) {
+        chunks.resize((*length + CHUNK - 1) / CHUNK);
+        std::atomic<bool> seekable = true;
+        pool->parallel_for(chunks.size(), [&](size_t i, size_t) {
+            size_t start = i * CHUNK;
+            size_t from = start - std::min(start, PREROLL);
+            auto stream = reader();
+            if (from != 0 && !stream.seek(from)) {
+                seekable = false;
+                return;
+            }
+            chunks[i] = scan(stream, start - from, CHUNK);
+        });
+        if (!seekable) {
+            chunks.clear();
+        }
+    }
+    if (chunks.empty()) {
+        auto stream = reader();
+        chunks.push_back(scan(stream, 0, SIZE_MAX));
+    }
+
+    double peak = 0.;
+    double squares = 0.;
+    size_t samples = 0;
+    std::vector<double> steps;
+    for (auto &chunk : chunks) {
+        peak = std::max(peak, chunk.peak);
+        squares += chunk.squares;
+        samples += chunk.samples;
+        steps.insert(steps.end(), chunk.steps.begin(), chunk.steps.end());
+    }
+
+    // samples are in the int16 scale
+    const double FULL_SCALE = 32768.;
+    Loudness result;
+    result.peak = peak / FULL_SCALE;
+    if (samples > 0) {
+        result.rms = std::sqrt(squares / (double)samples) / FULL_SCALE;
+    }
+
+    // mean squares of the complete blocks, then the absolute gate at
+    // -70 LUFS and the relative one 10 LU below the loudness of the blocks
+    // passing the first
+    auto lufs = [](double z) { return -0.691 + 10. * std::log10(z); };
+    std::vector<double> blocks;
+    for (size_t j = 0; (j + 4) * STEP <= samples; j++) {
+        double sum = steps[j] + steps[j + 1] + steps[j + 2] + steps[j + 3];
+        double z = sum / (4. * STEP) / (FULL_SCALE * FULL_SCALE);
+        if (lufs(z) > -70.) {
+            blocks.push_back(z);
+        }
+    }
+
+    double sum = 0.;
+    for (auto z : blocks) {
+        sum += z;
+    }
+    if (!blocks.empty()) {
+        double gate = lufs(sum / (double)blocks.size()) - 10.;
+        double gated = 0.;
+        size_t count = 0;
+        for (auto z : blocks) {
+            if (lufs(z) > gate) {
+                gated += z;
+                count++;
+            }
+        }
+        result.lufs = lufs(gated / (double)count);
+    }
+
+    return result;
+}
+
+// measurements of earlier renders, in memory and, with `disk`, in files
+// under $XDG_CACHE_HOME (or ~/.cache). the key has to name everything the
+// track depends on, a file is only used if it holds the same key.
+struct LoudnessCache {
+    static std::optional<Loudness> get(const std::string &key, bool disk) {
+        {
+            std::lock_guard lock(mutex());
+            auto it = memory().find(key);
+            if (it != memory().end()) {
+                return it->second;
+            }
+        }
+
+        auto path = disk ? file(key) : std::filesystem::path();
+        if (path.empty()) {
+            return std::nullopt;
+        }
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream content;
+        content << in.rdbuf();
+        auto data = content.str();
+
+        auto header = key + "\n--\n";
+        if (!in || data.compare(0, header.size(), header) != 0) {
+            return std::nullopt;
+        }
+
+        // strtod, unlike streams, reads back -inf
+        const char *p = data.c_str() + header.size();
+        char *end = nullptr;
+        Loudness result;
+        result.peak = std::strtod(p, &end);
+        result.rms = std::strtod(end, &end);
+        result.lufs = std::strtod(end, &end);
+        if (*end != '\n') {
+            return std::nullopt;
+        }
+
+        std::lock_guard lock(mutex());
+        memory()[key] = result;
+        return result;
+    }
+
+    // failures to write the file are ignored, it's only a cache
+    static void put(const std::string &key, const Loudness &loudness,
+                    bool disk) {
+        {
+            std::lock_guard lock(mutex());
+            memory()[key] = loudness;
+        }
+
+        auto path = disk ? file(key) : std::filesystem::path();
+        if (path.empty()) {
+            return;
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(path.parent_path(), error);
+        if (error) {
+            return;
+        }
+
+        // written next to the file and renamed, so readers never see half
+        // of it
+        auto temp = path;
+        temp += format(".", std::random_device()());
+        {
+            std::ofstream out(temp, std::ios::binary);
+            out << key << "\n--\n"
+                << std::setprecision(17) << loudness.peak << " "
+                << loudness.rms << " " << loudness.lufs << "\n";
+            if (!out) {
+                out.close();
+                std::filesystem::remove(temp, error);
+                return;
+            }
+        }
+        std::filesystem::rename(temp, path, error);
+        if (error) {
+            std::filesystem::remove(temp, error);
+        }
+    }
+
+  private:
+    static std::filesystem::path file(const std::string &key) {
+        std::filesystem::path dir;
+        auto xdg = std::getenv("XDG_CACHE_HOME");
+        auto home = std::getenv("HOME");
+        if (xdg != nullptr && xdg[0] != '\0') {
+            dir = xdg;
+        } else if (home != nullptr && home[0] != '\0') {
+            dir = std::filesystem::path(home) / ".cache";
+        } else {
+            return {};
+        }
+
+        // fnv-1a
+        std::uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : key) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        std::stringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << hash;
+
+        return dir / "audio-plugins" / "loudness" / name.str();
+    }
+
+    static std::mutex &mutex() {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::unordered_map<std::string, Loudness> &memory() {
+        static std::unordered_map<std::string, Loudness> m;
+        return m;
+    }
+};
+
+#endif
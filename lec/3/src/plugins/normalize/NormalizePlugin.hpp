@@ -0,0 +1,140 @@
+#ifndef APP_NORMALIZE_PLUGIN_H
+#define APP_NORMALIZE_PLUGIN_H
+
+#include "../../App.hpp"
+#include "../../pointwise.hpp"
+#include "Loudness.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+enum class NormalizeMode { lufs, peak, rms };
+
+// measures the main track when the graph is built and applies the gain
+// that brings it to the target, a whole-track pass before the render.
+// measurements are cached by the input files and the steps before, on disk
+// unless RenderOptions::disk_cache is off.
+struct NormalizeStep : public Step {
+    NormalizeStep(NormalizeMode mode, double target)
+        : mode(mode), target(target) {
+    }
+
+    void apply(State &state) const override {
+        auto key = cache_key(state);
+        std::optional<Loudness> loudness;
+        if (key.has_value()) {
+            loudness = LoudnessCache::get(*key, state.disk_cache);
+        }
+        if (!loudness.has_value()) {
+            // inputs that aren't files may be pipes
+            loudness = measure_loudness(state.slots[0], state.pool.get(),
+                                        !key.has_value());
+            if (key.has_value()) {
+                LoudnessCache::put(*key, *loudness, state.disk_cache);
+            }
+        }
+
+        // silent tracks are left as they are
+        double level = 0.;
+        switch (mode) {
+        case NormalizeMode::lufs:
+            level = loudness->lufs;
+            break;
+        case NormalizeMode::peak:
+            level = 20. * std::log10(loudness->peak);
+            break;
+        case NormalizeMode::rms:
+            level = 20. * std::log10(loudness->rms);
+            break;
+        }
+        if (!std::isfinite(level)) {
+            return;
+        }
+
+        float gain = (float)std::pow(10., (target - level) / 20.);
+        fuse(state.slots[0], GainKernel{.gain = gain});
+    }
+
+    NormalizeMode mode;
+    // dBFS for peak and rms, LUFS for lufs
+    double target;
+
+  private:
+    // the inputs by path, size and modification time, and the steps that
+    // built the main track from them. tracks read from pipes aren't cached.
+    static std::optional<std::string> cache_key(const State &state) {
+        std::string key = "normalize 1\n";
+        for (auto &input : state.inputs) {
+            std::error_code error;
+            auto path = std::filesystem::canonical(input, error);
+            if (error || !std::filesystem::is_regular_file(path, error)) {
+                return std::nullopt;
+            }
+            auto size = std::filesystem::file_size(path, error);
+            auto time = std::filesystem::last_write_time(path, error);
+            if (error) {
+                return std::nullopt;
+            }
+            key += format(path.string(), " ", size, " ",
+                          time.time_since_epoch().count(), "\n");
+        }
+        return key + state.history;
+    }
+};
+
+struct NormalizeCommand : public Command {
+    std::string name() const override {
+        return "normalize";
+    }
+
+    std::string help() const override {
+        return ("    normalize [lufs|peak|rms] <target>\n"
+                "    changes volume of the main track so its integrated "
+                "loudness (in LUFS,\n"
+                "    the default), sample peak or rms level (in dBFS) "
+                "reaches the target.\n"
+                "    the whole track is read to measure it before the "
+                "render starts. if\n"
+                "    the track comes from a pipe, all of it is kept in "
+                "memory until the\n"
+                "    render reads it. measurements of files are cached "
+                "under ~/.cache,\n"
+                "    see --no-cache.");
+    }
+
+    std::unique_ptr<Step> parse(Context &ctx) const override {
+        auto mode = NormalizeMode::lufs;
+        if (*ctx != '-' && *ctx != '+' && *ctx != '.' && !is_digit(*ctx)) {
+            auto at = ctx.position;
+            auto word = read_word(ctx, "normalize mode");
+            if (word == "lufs") {
+                mode = NormalizeMode::lufs;
+            } else if (word == "peak") {
+                mode = NormalizeMode::peak;
+            } else if (word == "rms") {
+                mode = NormalizeMode::rms;
+            } else {
+                throw ConfigError(at, ctx.position,
+                                  "normalize mode must be lufs, peak or rms");
+            }
+            skip_idents(ctx);
+        }
+
+        auto target = read_decimal<double>(ctx);
+
+        skip_idents(ctx);
+
+        return std::make_unique<NormalizeStep>(mode, target);
+    }
+};
+
+struct NormalizePlugin : public Plugin {
+    void register_at(App &app) const override {
+        app.register_command(std::move(NormalizeCommand()));
+    }
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef APP_PIPELINE_PLUGIN_H
+#define APP_PIPELINE_PLUGIN_H
+
+#include "../../App.hpp"
+#include "../../streams/PipeStream.hpp"
+
+struct PipelineStep : public Step {
+    void apply(State &state) const override {
+        auto s = std::move(state.slots[0]);
+        state.slots[0] = box_stream<PipeStream>(std::move(s));
+    }
+};
+
+struct PipelineCommand : public Command {
+    std::string name() const override {
+        return "pipeline";
+    }
+
+    std::string help() const override {
+        return ("    pipeline\n"
+                "    runs all previous commands on a separate thread, "
+                "the following ones\n"
+                "    consume their output through a buffer.");
+    }
+
+    std::unique_ptr<Step> parse(Context &) const override {
+        return std::make_unique<PipelineStep>();
+    }
+};
+
+struct PipelinePlugin : public Plugin {
+    void register_at(App &app) const override {
+        app.register_command(std::move(PipelineCommand()));
+    }
+};
+
+#endif
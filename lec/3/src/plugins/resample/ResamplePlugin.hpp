@@ -2,7 +2,26 @@
 #define APP_RESAMPLE_PLUGIN_H
 
 #include "../../App.hpp"
-#include "ResampleStream.hpp"
+#include "../../streams/ResampleStream.hpp"
+
+struct ResampleStep : public Step {
+    ResampleStep(size_t up, size_t down) : up(up), down(down) {
+    }
+
+    bool heavy() const override {
+        return true;
+    }
+
+    void apply(State &state) const override {
+        auto s = std::move(state.slots[0]);
+        state.slots[0] =
+            box_stream<ResampleStream<StreamBox<float>>>(std::move(s), up, down);
+    }
+
+    // the track gets up / down times as many samples
+    size_t up;
+    size_t down;
+};
 
 struct ResampleCommand : public Command {
     std::string name() const override {
@@ -15,15 +34,16 @@ struct ResampleCommand : public Command {
             "    speeds up or slows down the main track by specified factor.");
     }
 
-    void run(State &state) override {
-        auto factor = read_unsigned<size_t>(state.ctx);
-        skip_idents(state.ctx);
-        skip_word(state.ctx, "%");
+    std::unique_ptr<Step> parse(Context &ctx) const override {
+        auto start = ctx.position;
+        auto percent = read_unsigned<size_t>(ctx);
+        if (percent == 0) {
+            throw ConfigError(start, ctx.position, "speed must be positive");
+        }
+        skip_idents(ctx);
+        skip_word(ctx, "%");
 
-        auto s = state.slots[0];
-        auto m = box_stream<ResampleStream<StreamBox<float>>>(
-            std::move(s), (float)factor / 100.);
-        state.slots[0] = m;
+        return std::make_unique<ResampleStep>(percent, 100);
     }
 };
 
@@ -33,4 +53,4 @@ struct ResamplePlugin : public Plugin {
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -2,8 +2,42 @@
 #define APP_VOCODER_PLUGIN_H
 
 #include "../../App.hpp"
+#include "../../streams/SpectralStream.hpp"
 #include "VocoderStream.hpp"
 
+#include <memory>
+
+// window of the analysis, in samples
+const size_t VOCODER_WINDOW = 2048;
+const size_t VOCODER_HOP = 1024;
+const size_t VOCODER_BANDS = 40;
+
+// consecutive vocoders stay separate steps: running them on one analysis
+// would skip resynthesizing the track in between and change the output
+struct VocoderStep : public Step {
+    VocoderStep(SlotRef carrier) : carrier(carrier) {
+    }
+
+    bool heavy() const override {
+        return true;
+    }
+
+    void apply(State &state) const override {
+        auto b = state.share(carrier);
+
+        auto a = std::move(state.slots[0]);
+        auto stream = box_stream<SpectralStream>(std::move(a), VOCODER_WINDOW,
+                                                 VOCODER_HOP, state.pool);
+        auto spectral = stream.as<SpectralStream>();
+        auto input = spectral->add_input(std::move(b));
+        spectral->push(std::make_shared<VocoderProcessor>(
+            input, VOCODER_WINDOW, VOCODER_BANDS));
+        state.slots[0] = std::move(stream);
+    }
+
+    SlotRef carrier;
+};
+
 struct VocoderCommand : public Command {
     std::string name() const override {
         return "vocoder";
@@ -14,16 +48,12 @@ struct VocoderCommand : public Command {
                 "    makes your speech sound like a song");
     }
 
-    void run(State &state) override {
-        auto mix_with = state.read_slot();
+    std::unique_ptr<Step> parse(Context &ctx) const override {
+        auto carrier = read_slot_ref(ctx);
 
-        skip_idents(state.ctx);
+        skip_idents(ctx);
 
-        auto a = state.slots[0];
-        auto b = state.slots[mix_with - 1];
-        auto m = box_stream<VocoderStream<StreamBox<float>, StreamBox<float>>>(
-            std::move(a), std::move(b), 2048, 1024);
-        state.slots[0] = m;
+        return std::make_unique<VocoderStep>(carrier);
     }
 };
 
@@ -33,4 +63,4 @@ struct VocoderPlugin : public Plugin {
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,63 +1,39 @@
 #ifndef APP_VOCODER_STREAM_H
 #define APP_VOCODER_STREAM_H
 
-#include <cassert>
 #include <cmath>
 #include <complex>
-#include <cstdint>
-#include <cstring>
-#include <iostream>
-#include <optional>
-#include <stdexcept>
-#include <vector>
+#include <span>
 
+#include "../../streams/SpectralStream.hpp"
 #include "../../streams/Stream.hpp"
 
-#include "../../streams/WindowStream.hpp"
-#include "../../streams/Windower.hpp"
-
 #include "../../misc/MelFilterBank.hpp"
-#include "../../misc/fft.hpp"
 
-template <IsStream<float> A, IsStream<float> B>
-class VocoderStream : public WindowStream {
-  public:
-    VocoderStream(A &&a, B &&b, size_t window_size, size_t window_hop,
-                  size_t bands = 40)
-        : a(std::move(a)), b(std::move(b)),
-          WindowStream(window_size, window_hop), a_windower(window_size),
-          b_windower(window_size), win_f(window_size), a_fft(window_size),
-          b_fft(window_size), abs_a(window_size / 2), abs_b(window_size / 2),
-          bank(window_size / 2, 0., window_size / 2., window_size, bands),
-          env_fft_a(bands), env_fft_b(bands) {
-        for (size_t i = 0; i < window_size; i++) {
-            float p = std::sin(M_PI * (float)i / (float)window_size);
-            win_f[i] = p * p;
-        }
+// gives the carrier (a side input of the SpectralStream) the spectral
+// envelope of the main track: both spectra are smoothed through a mel
+// filter bank, and every bin of the carrier is scaled by the ratio of the
+// envelopes
+struct VocoderProcessor : public SpectralProcessor {
+    VocoderProcessor(size_t carrier, size_t window_size, size_t bands)
+        : carrier(carrier), half(window_size / 2), bands(bands),
+          bank(window_size / 2, 0., window_size / 2., window_size, bands) {
     }
 
-    bool add_window() override {
-        auto ra = a_windower.read_from(a, hop);
-        auto rb = b_windower.read_from(b, hop);
-        if (ra < hop || rb < hop) {
-            return false;
-        }
-
-        for (size_t i = 0; i < output_buffer.size(); i++) {
-            a_fft[i] = a_windower.buffer[i] * win_f[i];
-            b_fft[i] = b_windower.buffer[i] * win_f[i];
-        }
+    void process(SpectralFrame &frame) const override {
+        auto a_fft = frame.spectrum;
+        auto b_fft = frame.input(carrier);
 
-        fft2(a_fft, false);
-        fft2(b_fft, false);
+        auto abs_a = frame.scratch.subspan(0, half);
+        auto abs_b = frame.scratch.subspan(half, half);
+        auto env_fft_a = frame.scratch.subspan(2 * half, bands);
+        auto env_fft_b = frame.scratch.subspan(2 * half + bands, bands);
 
-        for (size_t i = 0; i < win_f.size() / 2; i++) {
+        for (size_t i = 0; i < half; i++) {
             abs_a[i] = std::abs(a_fft[i]) * std::abs(a_fft[i]);
             abs_b[i] = std::abs(b_fft[i]) * std::abs(b_fft[i]);
         }
 
-        size_t bands = env_fft_a.size();
-
         bank.apply(abs_a, env_fft_a);
         for (size_t i = 0; i < bands; i++) {
             env_fft_a[i] = std::sqrt(env_fft_a[i]);
@@ -70,53 +46,25 @@ class VocoderStream : public WindowStream {
         }
         bank.reconstruct(env_fft_b, abs_b);
 
-        for (size_t i = 0; i < a_fft.size() / 2; i++) {
+        for (size_t i = 0; i < half; i++) {
             if (abs_b[i] == 0.) {
                 a_fft[i] = b_fft[i];
             } else {
                 a_fft[i] = (b_fft[i] * abs_a[i] / abs_b[i]) * (float)2.;
             }
         }
-
-        for (size_t i = a_fft.size() / 2; i < a_fft.size(); i++) {
-            a_fft[i] = std::conj(a_fft[a_fft.size() - i]);
-        }
-
-        fft2(a_fft, true);
-
-        for (size_t i = 0; i < output_buffer.size(); i++) {
-            output_buffer[i] += a_fft[i].real();
-        }
-
-        return true;
     }
 
-    std::optional<size_t> length() const override {
-        return a.length();
-    }
-
-    StreamBox<float> clone() const override {
-        return box_stream<VocoderStream<A, B>>(*this);
+    size_t scratch_size() const override {
+        return 2 * half + 2 * bands;
     }
 
   private:
-    A a;
-    B b;
-
-    std::vector<float> win_f;
-
-    Windower<float> a_windower;
-    Windower<float> b_windower;
-
-    std::vector<std::complex<float>> a_fft;
-    std::vector<std::complex<float>> b_fft;
-
-    std::vector<float> abs_a;
-    std::vector<float> env_fft_a;
-    std::vector<float> abs_b;
-    std::vector<float> env_fft_b;
-
+    size_t carrier;
+    // bins below the nyquist one
+    size_t half;
+    size_t bands;
     MelFilterBank bank;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,29 @@
+#ifndef APP_POINTWISE_H
+#define APP_POINTWISE_H
+
+#include "streams/FusedStream.hpp"
+#include "streams/Stream.hpp"
+
+#include "plugins/filter/FilterStream.hpp"
+#include "plugins/gain/GainStream.hpp"
+#include "plugins/mix/MixStream.hpp"
+#include "plugins/mute/MuteStream.hpp"
+
+// node that all pointwise commands are lowered into, along with filters,
+// which work on blocks in place the same way
+using PointwiseStream = FusedStream<MuteKernel, MixBusKernel<StreamBox<float>>,
+                                    GainKernel, BiquadKernel>;
+
+// appends a pointwise stage to the slot. consecutive pointwise commands end
+// up in the same node, anything else (vocoder, resample, pipeline) starts a
+// new one.
+template <typename K> static void fuse(StreamBox<float> &slot, K &&kernel) {
+    auto fused = slot.as<PointwiseStream>();
+    if (fused == nullptr) {
+        slot = box_stream<PointwiseStream>(std::move(slot));
+        fused = slot.as<PointwiseStream>();
+    }
+    fused->push(std::forward<K>(kernel));
+}
+
+#endif
@@ -3,15 +3,25 @@
 
 #include "App.hpp"
 
+#include "plugins/convolve/ConvolvePlugin.hpp"
+#include "plugins/filter/FilterPlugin.hpp"
+#include "plugins/gain/GainPlugin.hpp"
 #include "plugins/mix/MixPlugin.hpp"
 #include "plugins/mute/MutePlugin.hpp"
+#include "plugins/normalize/NormalizePlugin.hpp"
+#include "plugins/pipeline/PipelinePlugin.hpp"
 #include "plugins/resample/ResamplePlugin.hpp"
 #include "plugins/vocoder/VocoderPlugin.hpp"
 
 static App create_app() {
     App app;
+    app.register_plugin(ConvolvePlugin());
+    app.register_plugin(FilterPlugin());
+    app.register_plugin(GainPlugin());
     app.register_plugin(MixPlugin());
     app.register_plugin(MutePlugin());
+    app.register_plugin(NormalizePlugin());
+    app.register_plugin(PipelinePlugin());
     app.register_plugin(ResamplePlugin());
     app.register_plugin(VocoderPlugin());
     return app;
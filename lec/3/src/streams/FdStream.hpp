@@ -0,0 +1,57 @@
+#ifndef APP_FD_STREAM_H
+#define APP_FD_STREAM_H
+
+#include "../misc/Trace.hpp"
+#include "../streams/Stream.hpp"
+
+#include <cerrno>
+#include <memory>
+#include <optional>
+#include <span>
+#include <system_error>
+
+#include <unistd.h>
+
+// reads from an already open file descriptor, like stdin or a pipe. such
+// inputs can't be reopened, so clones share the descriptor and its
+// position: only one of them should actually be read.
+struct FdStream : public Stream<char> {
+    FdStream(int fd) : shared(std::make_shared<Shared>(fd, false)) {
+    }
+
+    std::optional<size_t> read(std::span<char> buffer) override {
+        if (shared->ended) {
+            return std::nullopt;
+        }
+
+        TraceScope trace("fd read", "io");
+        while (true) {
+            auto r = ::read(shared->fd, buffer.data(), buffer.size());
+            if (r < 0 && errno == EINTR) {
+                continue;
+            } else if (r < 0) {
+                throw std::system_error(errno, std::generic_category());
+            }
+            trace.set_arg("bytes", r);
+            if (r == 0 && buffer.size() != 0) {
+                shared->ended = true;
+                return std::nullopt;
+            }
+            return std::make_optional((size_t)r);
+        }
+    }
+
+    StreamBox<char> clone() const override {
+        return box_stream<FdStream>(*this);
+    }
+
+  private:
+    struct Shared {
+        int fd;
+        bool ended;
+    };
+
+    std::shared_ptr<Shared> shared;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef APP_FILE_STREAM_H
 #define APP_FILE_STREAM_H
 
+#include "../misc/Trace.hpp"
 #include "../streams/Stream.hpp"
 #include <fstream>
 #include <iostream>
@@ -33,6 +34,7 @@ struct FileStream : public Stream<char> {
             open();
         }
 
+        TraceScope trace("file read", "io");
         if (!fstream->read(buffer.data(), buffer.size())) {
             if (fstream->eof()) {
                 ended = true;
@@ -42,11 +44,29 @@ struct FileStream : public Stream<char> {
         }
 
         size_t read = fstream->gcount();
+        trace.set_arg("bytes", read);
         pos += read;
 
         return std::make_optional(read);
     }
 
+    // fails for pipes and other files without a position
+    bool seek(size_t to) override {
+        if (!fstream.has_value()) {
+            open();
+        }
+
+        fstream->clear();
+        if (!fstream->seekg(to)) {
+            fstream->clear();
+            return false;
+        }
+
+        pos = to;
+        ended = false;
+        return true;
+    }
+
     StreamBox<char> clone() const override {
         return box_stream<FileStream>(*this);
     }
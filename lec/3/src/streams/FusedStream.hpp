@@ -0,0 +1,138 @@
+#ifndef APP_FUSED_STREAM_H
+#define APP_FUSED_STREAM_H
+
+#include <algorithm>
+#include <optional>
+#include <variant>
+#include <vector>
+
+#include "../streams/Stream.hpp"
+
+// runs a sequence of pointwise stages over each block of the source in one
+// node: the block is read straight into the caller's buffer and every stage
+// works on it in place, without virtual calls or buffers between stages.
+// stages needing extra input (like mixes) share a single scratch buffer.
+//
+// stages can seek to a position of the main track. a stage that silences a
+// range (see MuteKernel::silent_until) lets the source and all stages before
+// it seek past that range instead of producing samples that would be
+// overwritten anyway.
+template <typename... Kernels> struct FusedStream : public Stream<float> {
+    using Kernel = std::variant<Kernels...>;
+
+    FusedStream(StreamBox<float> &&source, size_t block_size = 4096)
+        : source(std::move(source)), scratch(block_size), offset(0) {
+    }
+
+    void push(Kernel &&kernel) {
+        kernels.push_back(std::move(kernel));
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        auto block = out.subspan(0, std::min(out.size(), scratch.size()));
+
+        size_t first = skip_silence(block);
+        if (first == 0) {
+            auto r = source.read(block);
+            if (!r.has_value()) {
+                return std::nullopt;
+            }
+            block = block.subspan(0, *r);
+        }
+
+        for (size_t i = first; i < kernels.size(); i++) {
+            std::visit([&](auto &k) { k.process(block, offset, scratch); },
+                       kernels[i]);
+        }
+
+        offset += block.size();
+        return std::make_optional(block.size());
+    }
+
+    bool seek(size_t pos) override {
+        if (!seek_stages(kernels.size(), pos)) {
+            return false;
+        }
+        offset = pos;
+        return true;
+    }
+
+    std::optional<size_t> length() const override {
+        return source.length();
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<FusedStream<Kernels...>>(*this);
+    }
+
+  private:
+    // if a stage silences the start of the block and everything before it
+    // can seek past the silence, the block is shortened to the silent part,
+    // zeroed and the stages after it are the only ones left to run. returns
+    // the index of the first stage to run, 0 if the source has to be read.
+    size_t skip_silence(std::span<float> &block) {
+        auto len = source.length();
+        if (!len.has_value() || offset >= *len) {
+            return 0;
+        }
+
+        size_t first = 0;
+        size_t until = offset;
+        for (size_t i = 0; i < kernels.size(); i++) {
+            std::visit(
+                [&](auto &k) {
+                    if constexpr (requires { k.silent_until(offset); }) {
+                        auto end = k.silent_until(offset);
+                        if (end > offset) {
+                            first = i + 1;
+                            until = end;
+                        }
+                    }
+                },
+                kernels[i]);
+        }
+        if (first == 0) {
+            return 0;
+        }
+
+        size_t n = std::min({block.size(), until - offset, *len - offset});
+        if (!seek_stages(first - 1, offset + n)) {
+            return 0;
+        }
+
+        block = block.subspan(0, n);
+        std::fill(block.begin(), block.end(), 0.f);
+        return first;
+    }
+
+    // seeks the source and the first `count` stages. if one of them can't
+    // seek, the ones that already moved are put back to `offset`.
+    bool seek_stages(size_t count, size_t pos) {
+        for (size_t i = 0; i < count; i++) {
+            bool ok = std::visit([&](auto &k) { return k.seek(pos); },
+                                 kernels[i]);
+            if (!ok) {
+                rewind_stages(i);
+                return false;
+            }
+        }
+        if (!source.seek(pos)) {
+            rewind_stages(count);
+            return false;
+        }
+        return true;
+    }
+
+    void rewind_stages(size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            std::visit([&](auto &k) { k.seek(offset); }, kernels[i]);
+        }
+    }
+
+    StreamBox<float> source;
+    std::vector<Kernel> kernels;
+    std::vector<float> scratch;
+    size_t offset;
+};
+
+#endif
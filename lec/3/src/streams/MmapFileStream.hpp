@@ -0,0 +1,114 @@
+#ifndef APP_MMAP_FILE_STREAM_H
+#define APP_MMAP_FILE_STREAM_H
+
+#include "../misc/Trace.hpp"
+#include "../streams/Stream.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// read-only mapping of a whole file, shared between clones of a stream
+struct FileMapping {
+    FileMapping(const std::string &path) : data(nullptr), size(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), path);
+        }
+
+        size = st.st_size;
+
+        if (size != 0) {
+            void *ptr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr == MAP_FAILED) {
+                int err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), path);
+            }
+            ::madvise(ptr, size, MADV_SEQUENTIAL);
+            data = (const char *)ptr;
+        }
+
+        ::close(fd);
+    }
+
+    FileMapping(const FileMapping &) = delete;
+    FileMapping &operator=(const FileMapping &) = delete;
+
+    ~FileMapping() {
+        if (data != nullptr) {
+            ::munmap((void *)data, size);
+        }
+    }
+
+    const char *data;
+    size_t size;
+};
+
+struct MmapFileStream : public Stream<char> {
+    MmapFileStream(const std::string &path)
+        : path(path), pos(0),
+          mapping(std::make_shared<const FileMapping>(path)) {
+    }
+
+    std::optional<size_t> read(std::span<char> buffer) override {
+        if (pos == mapping->size) {
+            return std::nullopt;
+        }
+
+        size_t read = std::min(buffer.size(), mapping->size - pos);
+        TraceScope trace("file read", "io", "bytes", read);
+        std::memcpy(buffer.data(), mapping->data + pos, read);
+        pos += read;
+
+        return std::make_optional(read);
+    }
+
+    size_t skip(size_t n) override {
+        size_t skipped = std::min(n, mapping->size - pos);
+        pos += skipped;
+        return skipped;
+    }
+
+    bool seek(size_t to) override {
+        pos = std::min(to, mapping->size);
+        return true;
+    }
+
+    std::optional<size_t> length() const override {
+        return std::make_optional(mapping->size);
+    }
+
+    StreamBox<char> clone() const override {
+        return box_stream<MmapFileStream>(*this);
+    }
+
+    // whole mapped file, independent of the read position
+    std::span<const char> view() const {
+        return std::span(mapping->data, mapping->size);
+    }
+
+    std::string path;
+    size_t pos;
+
+  private:
+    std::shared_ptr<const FileMapping> mapping;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef APP_MMAP_WAV_STREAM_H
+#define APP_MMAP_WAV_STREAM_H
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include "../misc/Trace.hpp"
+#include "../misc/convert.hpp"
+#include "../streams/MmapFileStream.hpp"
+#include "../streams/Stream.hpp"
+#include "../streams/WavStream.hpp"
+
+// WAV source that decodes straight from a memory-mapped file, without
+// intermediate buffers
+class MmapWavStream : public Stream<float> {
+  public:
+    MmapWavStream(MmapFileStream &&file)
+        : file(std::move(file)), samples(nullptr), rate(0), len(0),
+          offset(0) {
+        prepare();
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        if (offset == len) {
+            return std::nullopt;
+        }
+
+        size_t r = std::min(out.size(), len - offset);
+        TraceScope trace("decode", "io", "samples", r);
+        int16_to_float(samples + offset * 2, out.subspan(0, r));
+
+        offset += r;
+
+        return std::make_optional(r);
+    }
+
+    size_t skip(size_t n) override {
+        size_t skipped = std::min(n, len - offset);
+        offset += skipped;
+        return skipped;
+    }
+
+    bool seek(size_t pos) override {
+        offset = std::min(pos, len);
+        return true;
+    }
+
+    std::optional<size_t> length() const override {
+        return std::make_optional(len);
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<MmapWavStream>(*this);
+    }
+
+    size_t sample_rate() const noexcept {
+        return rate;
+    }
+
+  private:
+    void prepare() {
+        auto data = file.view();
+
+        // read header
+        WavHeader header;
+        if (data.size() < sizeof(header)) {
+            throw std::runtime_error("incorrect wav file");
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        check_wav_header(header);
+        rate = header.sample_rate;
+
+        // find data chunk
+        size_t pos = sizeof(header);
+        while (1) {
+            if (data.size() - pos < 8) {
+                throw std::runtime_error("incorrect wav file");
+            }
+
+            const char *id = data.data() + pos;
+            std::uint32_t size;
+            std::memcpy(&size, data.data() + pos + 4, 4);
+            pos += 8;
+
+            if (std::memcmp(id, "data", 4)) {
+                if (data.size() - pos < size) {
+                    throw std::runtime_error("incorrect wav file");
+                }
+                pos += size;
+            } else {
+                // streamed files may leave the size unset, in that case
+                // samples continue until the end of the file
+                size_t available = data.size() - pos;
+                if (size == 0 || size > available) {
+                    size = available - available % 2;
+                } else if (size % 2 == 1) {
+                    throw std::runtime_error("incorrect wav file");
+                }
+
+                samples = data.data() + pos;
+                len = size / 2;
+                break;
+            }
+        }
+    }
+
+    MmapFileStream file;
+    const char *samples;
+    size_t rate;
+    size_t len;
+    size_t offset;
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef APP_PIPE_STREAM_H
+#define APP_PIPE_STREAM_H
+
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "../misc/RingBuffer.hpp"
+#include "../streams/Stream.hpp"
+
+// runs the upstream chain on its own thread and hands blocks of samples
+// over through a ring buffer. the thread is started on the first read.
+// cloning a started stream holds the thread between two blocks, and the
+// clone starts with the samples that were produced but not read yet.
+struct PipeStream : public Stream<float> {
+    struct Block {
+        std::vector<float> data;
+        size_t size = 0;
+    };
+
+    PipeStream(StreamBox<float> &&stream, size_t blocks = 8,
+               size_t block_size = 4096)
+        : stream(std::move(stream)), blocks(blocks), block_size(block_size),
+          ring(blocks, Block{.data = std::vector<float>(block_size)}),
+          pending_offset(0), started(false), ended(false), block_offset(0) {
+    }
+
+    PipeStream(const PipeStream &pipe)
+        : PipeStream(StreamBox<float>(), pipe.blocks, pipe.block_size) {
+        std::lock_guard lock(pipe.mutex);
+        stream = pipe.stream.clone();
+        size_t from = pipe.block_offset;
+        pipe.ring.each([&](const Block &block) {
+            pending.insert(pending.end(), block.data.begin() + from,
+                           block.data.begin() + block.size);
+            from = 0;
+        });
+    }
+
+    ~PipeStream() {
+        stop();
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        if (ended) {
+            return std::nullopt;
+        }
+
+        if (!started) {
+            start();
+        }
+
+        if (pending_offset < pending.size()) {
+            auto r = std::min(out.size(), pending.size() - pending_offset);
+            std::memcpy(out.data(), pending.data() + pending_offset,
+                        r * sizeof(float));
+            pending_offset += r;
+            if (pending_offset == pending.size()) {
+                pending = {};
+                pending_offset = 0;
+            }
+            return std::make_optional(r);
+        }
+
+        auto block = ring.front();
+        if (block == nullptr) {
+            ended = true;
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return std::nullopt;
+        }
+
+        auto r = std::min(out.size(), block->size - block_offset);
+        std::memcpy(out.data(), block->data.data() + block_offset,
+                    r * sizeof(float));
+        block_offset += r;
+
+        if (block_offset == block->size) {
+            block_offset = 0;
+            ring.pop();
+        }
+
+        return std::make_optional(r);
+    }
+
+    // stops the worker, seeks upstream and lets the next read start over
+    bool seek(size_t pos) override {
+        stop();
+        if (!stream.seek(pos)) {
+            // blocks already in the ring are still valid, the worker
+            // continues after them on the next read
+            ring.resume();
+            return false;
+        }
+
+        ring.reset();
+        pending = {};
+        pending_offset = 0;
+        error = nullptr;
+        ended = false;
+        block_offset = 0;
+        return true;
+    }
+
+    std::optional<size_t> length() const override {
+        return stream.length();
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<PipeStream>(*this);
+    }
+
+  private:
+    void start() {
+        started = true;
+        worker = std::thread([this]() { produce(); });
+    }
+
+    void stop() {
+        if (started) {
+            ring.cancel();
+            worker.join();
+            started = false;
+        }
+    }
+
+    void produce() {
+        trace_thread_name("pipe");
+        try {
+            while (true) {
+                auto block = ring.begin_push();
+                if (block == nullptr) {
+                    return;
+                }
+
+                // clones lock the mutex to see the upstream and the ring
+                // between two blocks
+                std::lock_guard lock(mutex);
+                block->size = stream.read_full(block->data);
+
+                // the consumer sees the end of the stream once the ring is
+                // closed, so empty blocks aren't pushed
+                if (block->size != 0) {
+                    ring.end_push();
+                }
+
+                if (block->size < block_size) {
+                    break;
+                }
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        ring.close();
+    }
+
+    StreamBox<float> stream;
+    size_t blocks;
+    size_t block_size;
+
+    SpscRing<Block> ring;
+    std::thread worker;
+    std::exception_ptr error;
+    mutable std::mutex mutex;
+
+    // samples a clone took over from the stream it was cloned from
+    std::vector<float> pending;
+    size_t pending_offset;
+
+    bool started;
+    bool ended;
+    size_t block_offset;
+};
+
+#endif
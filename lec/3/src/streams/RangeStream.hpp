@@ -0,0 +1,69 @@
+#ifndef APP_RANGE_STREAM_H
+#define APP_RANGE_STREAM_H
+
+#include <algorithm>
+#include <optional>
+
+#include "../streams/Stream.hpp"
+
+// samples [start, end) of the stream. the stream is moved to `start` on the
+// first read, by seeking if it can and by reading through otherwise.
+template <IsStream<float> S> struct RangeStream : public Stream<float> {
+    RangeStream(S &&stream, size_t start, std::optional<size_t> end)
+        : stream(std::move(stream)), start(start), end(end), pos(0),
+          positioned(false) {
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        if (!positioned) {
+            positioned = true;
+            if (!stream.seek(start)) {
+                stream.skip(start);
+            }
+        }
+
+        if (end.has_value()) {
+            if (start + pos >= *end) {
+                return std::nullopt;
+            }
+            out = out.subspan(0, std::min(out.size(), *end - start - pos));
+        }
+
+        auto r = stream.read(out);
+        if (r.has_value()) {
+            pos += *r;
+        }
+        return r;
+    }
+
+    bool seek(size_t to) override {
+        if (!stream.seek(start + to)) {
+            return false;
+        }
+        pos = to;
+        positioned = true;
+        return true;
+    }
+
+    std::optional<size_t> length() const override {
+        auto r = stream.length();
+        if (!r.has_value()) {
+            return std::nullopt;
+        }
+        size_t len = std::min(*r, end.value_or(*r));
+        return std::make_optional(len - std::min(len, start));
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<RangeStream<S>>(*this);
+    }
+
+  private:
+    S stream;
+    size_t start;
+    std::optional<size_t> end;
+    size_t pos;
+    bool positioned;
+};
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef APP_RESAMPLE_STREAM_H
+#define APP_RESAMPLE_STREAM_H
+
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "../misc/simd.hpp"
+#include "../streams/Stream.hpp"
+
+// windowed-sinc lowpass split into `up` phases, one for every fractional
+// position an output sample can fall on. output sample k is the dot product
+// of phase (k * down) % up with `taps` input samples starting at
+// (k * down) / up, where the input is padded with `delay` zeros in front.
+struct PolyphaseFilter {
+    PolyphaseFilter(size_t up, size_t down) : up(up), down(down) {
+        if (up == 0 || down == 0) {
+            throw std::invalid_argument("resampling ratio must be positive");
+        }
+
+        // cutoff relative to the input nyquist frequency, a bit below the
+        // lower of both nyquists to leave room for the transition band
+        double cutoff = std::min(1., (double)up / (double)down) * 0.95;
+
+        // half-width is rounded up to a multiple of 4, so taps are a
+        // multiple of 8 and the dot product runs without a scalar tail
+        size_t half = std::ceil(ZERO_CROSSINGS / cutoff);
+        half = (half + 3) / 4 * 4;
+        taps = half * 2;
+        delay = half - 1;
+
+        coeffs.resize(up * taps);
+        double norm = bessel_i0(BETA);
+        for (size_t p = 0; p < up; p++) {
+            float *phase = coeffs.data() + p * taps;
+            double frac = (double)p / (double)up;
+
+            double sum = 0.;
+            for (size_t j = 0; j < taps; j++) {
+                double d = (double)j - (double)delay - frac;
+                double x = d / (double)half;
+                double window =
+                    std::abs(x) >= 1.
+                        ? 0.
+                        : bessel_i0(BETA * std::sqrt(1. - x * x)) / norm;
+                double h = cutoff * sinc(cutoff * d) * window;
+                phase[j] = h;
+                sum += h;
+            }
+
+            // unity gain at dc for every phase
+            for (size_t j = 0; j < taps; j++) {
+                phase[j] = (float)(phase[j] / sum);
+            }
+        }
+    }
+
+    // shared filter for the reduced ratio, created on first use
+    static std::shared_ptr<const PolyphaseFilter> get(size_t up, size_t down) {
+        static std::mutex mutex;
+        static std::map<std::pair<size_t, size_t>,
+                        std::shared_ptr<const PolyphaseFilter>>
+            filters;
+
+        if (up == 0 || down == 0) {
+            throw std::invalid_argument("resampling ratio must be positive");
+        }
+        auto g = std::gcd(up, down);
+        up /= g;
+        down /= g;
+
+        std::lock_guard lock(mutex);
+        auto &filter = filters[{up, down}];
+        if (!filter) {
+            filter = std::make_shared<const PolyphaseFilter>(up, down);
+        }
+        return filter;
+    }
+
+    const float *phase(size_t p) const noexcept {
+        return coeffs.data() + p * taps;
+    }
+
+    // number of output samples for `n` input samples
+    size_t output_length(size_t n) const noexcept {
+        return n * up / down;
+    }
+
+    size_t up;
+    size_t down;
+    size_t taps;
+    size_t delay;
+    std::vector<float> coeffs;
+
+  private:
+    static constexpr double ZERO_CROSSINGS = 16.;
+    static constexpr double BETA = 8.6;
+
+    static double sinc(double x) {
+        return x == 0. ? 1. : std::sin(M_PI * x) / (M_PI * x);
+    }
+
+    static double bessel_i0(double x) {
+        double sum = 1., term = 1.;
+        for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+            term *= (x / (2. * k)) * (x / (2. * k));
+            sum += term;
+        }
+        return sum;
+    }
+};
+
+// changes the number of samples by up / down. reads upstream in blocks and
+// keeps just enough history for the filter.
+template <IsStream<float> S> struct ResampleStream : public Stream<float> {
+    ResampleStream(S &&stream, size_t up, size_t down)
+        : stream(std::move(stream)), filter(PolyphaseFilter::get(up, down)),
+          buffer(filter->taps * 2 + BLOCK_SIZE), buffer_len(filter->delay),
+          offset(0), phase(0), produced(0), consumed(0), input_ended(false),
+          total(std::nullopt) {
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        auto taps = filter->taps;
+        auto up = filter->up;
+        auto down = filter->down;
+
+        size_t i = 0;
+        while (i < out.size()) {
+            if (total.has_value() && produced >= *total) {
+                break;
+            }
+
+            if (offset + taps > buffer_len) {
+                fill();
+                continue;
+            }
+
+            out[i++] =
+                simd_dot(buffer.data() + offset, filter->phase(phase), taps);
+            produced++;
+
+            phase += down;
+            offset += phase / up;
+            phase %= up;
+        }
+
+        if (i == 0 && out.size() != 0) {
+            return std::nullopt;
+        }
+        return std::make_optional(i);
+    }
+
+    // output sample `pos` starts its window at input sample
+    // pos * down / up - delay, the part of the window before the start of
+    // the input is filled with zeros
+    bool seek(size_t pos) override {
+        if (auto len = length(); len.has_value()) {
+            pos = std::min(pos, *len);
+        }
+
+        size_t start = pos * filter->down / filter->up;
+        size_t input = start > filter->delay ? start - filter->delay : 0;
+        if (!stream.seek(input)) {
+            return false;
+        }
+
+        buffer_len = input + filter->delay - start;
+        std::fill(buffer.begin(), buffer.begin() + buffer_len, 0.f);
+        offset = 0;
+        phase = pos * filter->down % filter->up;
+        produced = pos;
+        consumed = input;
+        input_ended = false;
+        return true;
+    }
+
+    std::optional<size_t> length() const override {
+        auto r = stream.length();
+        if (r.has_value()) {
+            return std::make_optional(filter->output_length(*r));
+        } else {
+            return total;
+        }
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<ResampleStream<S>>(*this);
+    }
+
+  private:
+    static constexpr size_t BLOCK_SIZE = 4096;
+
+    // drops history that is no longer needed and reads the next block. once
+    // upstream ends, zeros are appended so the last outputs see a full
+    // window.
+    void fill() {
+        // finish() pads for every output left, so this can't happen
+        if (input_ended) {
+            throw std::runtime_error("resampler ran out of input");
+        }
+
+        if (offset >= buffer_len) {
+            // large downsampling ratios step over whole blocks
+            size_t gap = offset - buffer_len;
+            size_t skipped = stream.skip(gap);
+            consumed += skipped;
+            buffer_len = 0;
+            offset = 0;
+            if (skipped < gap) {
+                finish();
+                return;
+            }
+        } else if (offset != 0) {
+            std::memmove(buffer.data(), buffer.data() + offset,
+                         (buffer_len - offset) * sizeof(float));
+            buffer_len -= offset;
+            offset = 0;
+        }
+
+        auto r = stream.read(std::span(buffer.data() + buffer_len,
+                                       buffer.size() - buffer_len));
+        if (!r.has_value()) {
+            finish();
+            return;
+        }
+        buffer_len += *r;
+        consumed += *r;
+    }
+
+    // pads the buffer with zeros up to the end of the window of the last
+    // output
+    void finish() {
+        input_ended = true;
+        total = filter->output_length(consumed);
+
+        size_t end = offset + filter->taps * 2;
+        if (produced < *total) {
+            size_t last = *total - produced - 1;
+            end = std::max(end, offset +
+                                    (phase + last * filter->down) / filter->up +
+                                    filter->taps);
+        }
+        if (buffer.size() < end) {
+            buffer.resize(end);
+        }
+        std::fill(buffer.begin() + buffer_len, buffer.end(), 0.f);
+        buffer_len = buffer.size();
+    }
+
+    S stream;
+    std::shared_ptr<const PolyphaseFilter> filter;
+
+    std::vector<float> buffer;
+    size_t buffer_len;
+    size_t offset;
+    size_t phase;
+
+    size_t produced;
+    size_t consumed;
+    bool input_ended;
+    std::optional<size_t> total;
+};
+
+#endif
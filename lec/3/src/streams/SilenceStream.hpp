@@ -0,0 +1,43 @@
+#ifndef APP_SILENCE_STREAM_H
+#define APP_SILENCE_STREAM_H
+
+#include <algorithm>
+#include <optional>
+
+#include "Stream.hpp"
+
+// `length` zero samples. a slot that is muted from start to end is replaced
+// by one, so nothing before the mute is computed at all.
+struct SilenceStream : public Stream<float> {
+    SilenceStream(size_t length) : total(length), pos(0) {
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        if (pos == total) {
+            return std::nullopt;
+        }
+        size_t r = std::min(out.size(), total - pos);
+        std::fill(out.begin(), out.begin() + r, 0.f);
+        pos += r;
+        return std::make_optional(r);
+    }
+
+    bool seek(size_t to) override {
+        pos = std::min(to, total);
+        return true;
+    }
+
+    std::optional<size_t> length() const override {
+        return std::make_optional(total);
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<SilenceStream>(*this);
+    }
+
+  private:
+    size_t total;
+    size_t pos;
+};
+
+#endif
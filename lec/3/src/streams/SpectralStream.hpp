@@ -0,0 +1,235 @@
+#ifndef APP_SPECTRAL_STREAM_H
+#define APP_SPECTRAL_STREAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "../misc/ThreadPool.hpp"
+#include "../misc/fft.hpp"
+#include "Stream.hpp"
+#include "WindowStream.hpp"
+#include "Windower.hpp"
+
+// one frame as seen by a SpectralProcessor. spectra hold the bins from 0 to
+// size / 2, the signals are real so the rest mirror them.
+struct SpectralFrame {
+    // spectrum of the main track, whatever the processors leave in it is
+    // turned back into samples. the imaginary parts of the first and last
+    // bins are ignored there.
+    std::span<std::complex<float>> spectrum;
+
+    // scratch_size() floats of the processor, not shared with other frames
+    std::span<float> scratch;
+
+    // spectrum of the side input with the index given by add_input()
+    std::span<const std::complex<float>> input(size_t i) const {
+        return std::span(inputs + i * stride, spectrum.size());
+    }
+
+    const std::complex<float> *inputs;
+    size_t stride;
+};
+
+// effect working on one frame at a time. processors are immutable, so
+// frames can be processed on several threads at once.
+struct SpectralProcessor {
+    virtual void process(SpectralFrame &frame) const = 0;
+
+    virtual size_t scratch_size() const {
+        return 0;
+    }
+
+    virtual ~SpectralProcessor() = default;
+};
+
+// short-time fourier transform around a chain of processors: the main track
+// and every side input are cut into sin^2 windows of `size` samples every
+// `hop` samples and transformed, the processors change the spectrum of the
+// main track, and the result is transformed back and overlap-added. each
+// input is analyzed once per frame however many processors read it.
+//
+// with a thread pool, frames are computed in batches of hops read ahead
+// from all inputs, every frame on its own worker. frames only depend on
+// their input windows, and overlap-add still happens in order, so the
+// output doesn't depend on the batch size.
+class SpectralStream : public WindowStream {
+  public:
+    SpectralStream(StreamBox<float> &&main, size_t size, size_t hop,
+                   std::shared_ptr<ThreadPool> pool = nullptr)
+        : WindowStream(size, hop), pool(pool), batch(pool ? 64 : 1),
+          window(size), frames(batch * size), frame_count(0), next_frame(0),
+          scratch_size(0), fft(RealFftPlan::get(size)) {
+        for (size_t i = 0; i < size; i++) {
+            float p = std::sin(M_PI * (float)i / (float)size);
+            window[i] = p * p;
+        }
+        sources.push_back(Source{
+            .stream = std::move(main),
+            .windower = Windower<float>(size + (batch - 1) * hop),
+        });
+    }
+
+    // adds a track the processors can read the spectrum of, returns its
+    // index for SpectralFrame::input(). inputs and processors have to be
+    // added before the first read.
+    size_t add_input(StreamBox<float> &&input) {
+        sources.push_back(Source{
+            .stream = std::move(input),
+            .windower = Windower<float>(window.size() + (batch - 1) * hop),
+        });
+        return sources.size() - 2;
+    }
+
+    void push(std::shared_ptr<const SpectralProcessor> processor) {
+        scratch_size = std::max(scratch_size, processor->scratch_size());
+        processors.push_back(std::move(processor));
+    }
+
+    bool add_window() override {
+        if (next_frame == frame_count && !analyze_batch()) {
+            return false;
+        }
+
+        overlap_add(frames.data() + next_frame * size);
+        next_frame++;
+
+        return true;
+    }
+
+    // one hop per whole hop of the shortest input
+    std::optional<size_t> length() const override {
+        size_t shortest = SIZE_MAX;
+        for (auto &source : sources) {
+            auto len = source.stream.length();
+            if (!len.has_value()) {
+                return std::nullopt;
+            }
+            shortest = std::min(shortest, *len);
+        }
+        return std::make_optional(shortest / hop * hop);
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<SpectralStream>(*this);
+    }
+
+  private:
+    struct Source {
+        StreamBox<float> stream;
+        Windower<float> windower;
+    };
+
+    // buffers of one worker: the bins of all inputs, main one first
+    struct Workspace {
+        std::vector<std::complex<float>> spectra;
+        std::vector<float> scratch;
+    };
+
+    // reads up to `batch` hops and computes their frames
+    bool analyze_batch() {
+        size_t shortest = SIZE_MAX;
+        for (auto &source : sources) {
+            auto r = source.windower.read_from(source.stream, batch * hop);
+            shortest = std::min(shortest, r);
+        }
+
+        frame_count = shortest / hop;
+        next_frame = 0;
+        if (frame_count == 0) {
+            return false;
+        }
+
+        size_t workers = pool ? pool->size() + 1 : 1;
+        if (workspaces.size() != workers) {
+            workspaces.assign(
+                workers,
+                Workspace{.spectra = std::vector<std::complex<float>>(
+                              sources.size() * (window.size() / 2 + 1)),
+                          .scratch = std::vector<float>(scratch_size)});
+        }
+
+        auto compute = [this](size_t frame, size_t slot) {
+            process_frame(frame, workspaces[slot]);
+        };
+
+        if (pool) {
+            pool->parallel_for(frame_count, compute);
+        } else {
+            for (size_t frame = 0; frame < frame_count; frame++) {
+                compute(frame, 0);
+            }
+        }
+
+        return true;
+    }
+
+    void process_frame(size_t frame, Workspace &ws) {
+        size_t n = window.size();
+        size_t bins = n / 2 + 1;
+
+        // inputs are transformed two at a time, the last one alone if
+        // their count is odd
+        size_t s = 0;
+        for (; s + 2 <= sources.size(); s += 2) {
+            auto pair = std::span(ws.spectra.data() + s * bins, 2 * bins);
+            const float *x = sources[s].windower.data() + frame * hop;
+            const float *y =
+                sources[s + 1].windower.data() + frame * hop;
+            for (size_t i = 0; i < n; i++) {
+                pair[i] = {x[i] * window[i], y[i] * window[i]};
+            }
+            fft->forward2(pair);
+        }
+        if (s < sources.size()) {
+            auto spectrum = std::span(ws.spectra.data() + s * bins, bins);
+            auto samples = RealFftPlan::samples(spectrum);
+            const float *x = sources[s].windower.data() + frame * hop;
+            for (size_t i = 0; i < n; i++) {
+                samples[i] = x[i] * window[i];
+            }
+            fft->forward(spectrum);
+        }
+
+        auto spectrum = std::span(ws.spectra.data(), bins);
+        SpectralFrame view{
+            .spectrum = spectrum,
+            .scratch = ws.scratch,
+            .inputs = ws.spectra.data() + bins,
+            .stride = bins,
+        };
+        for (auto &processor : processors) {
+            processor->process(view);
+        }
+
+        fft->inverse(spectrum);
+
+        auto samples = RealFftPlan::samples(spectrum);
+        std::copy(samples.begin(), samples.begin() + n,
+                  frames.begin() + frame * n);
+    }
+
+    std::shared_ptr<ThreadPool> pool;
+    size_t batch;
+
+    std::vector<float> window;
+    std::vector<Source> sources;
+    std::vector<std::shared_ptr<const SpectralProcessor>> processors;
+
+    // output of the frames of the current batch
+    std::vector<float> frames;
+    size_t frame_count;
+    size_t next_frame;
+
+    size_t scratch_size;
+    std::vector<Workspace> workspaces;
+
+    std::shared_ptr<const RealFftPlan> fft;
+};
+
+#endif
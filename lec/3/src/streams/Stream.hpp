@@ -1,6 +1,7 @@
 #ifndef APP_STREAM_H
 #define APP_STREAM_H
 
+#include "../misc/Probe.hpp"
 #include "../misc/util.hpp"
 
 #include <memory>
@@ -37,7 +38,7 @@ template <typename T> struct Stream {
     }
 
     virtual size_t skip(size_t n) {
-        T buf[10];
+        T buf[1024];
         size_t off = 0;
         while (off < n) {
             auto r = read(
@@ -50,6 +51,13 @@ template <typename T> struct Stream {
         return off;
     };
 
+    // moves to element `pos` counted from the start of the stream, so the
+    // next read starts there. streams that can't do this without reading
+    // everything before `pos` return false and stay where they are.
+    virtual bool seek([[maybe_unused]] size_t pos) {
+        return false;
+    }
+
     virtual std::optional<size_t> length() const {
         return std::nullopt;
     };
@@ -73,49 +81,100 @@ template <typename T> struct StreamBox : public Stream<T> {
     }
 
     StreamBox(const StreamBox<T> &box) {
-        u = std::move(box.clone().u);
+        auto c = box.clone();
+        u = std::move(c.u);
+        probe = std::move(c.probe);
     }
 
     Stream<T> &operator=(StreamBox<T> &box) {
-        u = std::move(box.clone().u);
+        auto c = box.clone();
+        u = std::move(c.u);
+        probe = std::move(c.probe);
         return *this;
     }
 
     StreamBox(StreamBox<T> &&box) {
         u = std::move(box.u);
+        probe = std::move(box.probe);
     }
 
     Stream<T> &operator=(StreamBox<T> &&box) {
         u = std::move(box.u);
+        probe = std::move(box.probe);
         return *this;
     }
 
     std::optional<size_t> read(std::span<T> buffer) override {
-        return u->read(buffer);
+        if (!probe) {
+            return u->read(buffer);
+        }
+        Probe::Scope scope(*probe);
+        auto r = u->read(buffer);
+        scope.samples = r.value_or(0);
+        return r;
     }
 
     std::optional<T> read_single() override {
-        return u->read_single();
+        if (!probe) {
+            return u->read_single();
+        }
+        Probe::Scope scope(*probe);
+        auto r = u->read_single();
+        scope.samples = r.has_value();
+        return r;
     }
 
     size_t read_full(std::span<T> buffer) override {
-        return u->read_full(buffer);
+        if (!probe) {
+            return u->read_full(buffer);
+        }
+        Probe::Scope scope(*probe);
+        auto r = u->read_full(buffer);
+        scope.samples = r;
+        return r;
     }
 
     size_t skip(size_t n) override {
+        if (!probe) {
+            return u->skip(n);
+        }
+        Probe::Scope scope(*probe);
         return u->skip(n);
     }
 
+    bool seek(size_t pos) override {
+        return u->seek(pos);
+    }
+
     std::optional<size_t> length() const override {
         return u->length();
     }
 
+    // clones are measured by the same probe
     StreamBox<T> clone() const override {
-        return u->clone();
+        auto c = u->clone();
+        c.probe = probe;
+        return c;
+    }
+
+    // the boxed stream if it has type S, nullptr otherwise
+    template <typename S> S *as() noexcept {
+        return dynamic_cast<S *>(u.get());
+    }
+
+    // counts reads of the boxed stream, see Probe. a box has at most one
+    // probe, attaching another one replaces it.
+    void attach(std::shared_ptr<Probe> p) noexcept {
+        probe = std::move(p);
+    }
+
+    Probe *probed() const noexcept {
+        return probe.get();
     }
 
   private:
     std::unique_ptr<Stream<T>> u;
+    std::shared_ptr<Probe> probe;
 };
 
 template <typename S, typename... Args>
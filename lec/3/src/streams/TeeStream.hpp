@@ -0,0 +1,256 @@
+#ifndef APP_TEE_STREAM_H
+#define APP_TEE_STREAM_H
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "../streams/Stream.hpp"
+
+// while one is alive, clones made on the same thread share nothing with the
+// streams they are cloned from: TeeStreams anywhere in the cloned graph are
+// forked (see TeeStream::fork) instead of getting another reader.
+struct ForkScope {
+    ForkScope() : previous(active()) {
+        active() = true;
+    }
+
+    ForkScope(const ForkScope &) = delete;
+
+    ~ForkScope() {
+        active() = previous;
+    }
+
+    static bool &active() {
+        static thread_local bool forking = false;
+        return forking;
+    }
+
+  private:
+    bool previous;
+};
+
+// one of several readers of a shared upstream. clones are new readers at
+// the same position, so a subgraph used in many places is computed once.
+// samples are buffered from the slowest reader up to the fastest one and
+// dropped as soon as every reader is past them. readers may live on
+// different threads.
+struct TeeStream : public Stream<float> {
+    TeeStream(StreamBox<float> &&upstream)
+        : shared(std::make_shared<Shared>(std::move(upstream))), pos(0) {
+        std::lock_guard lock(shared->mutex);
+        shared->readers.push_back(this);
+    }
+
+    TeeStream(const TeeStream &tee) : shared(tee.shared), pos(0) {
+        std::lock_guard lock(shared->mutex);
+        pos = tee.pos;
+        shared->readers.push_back(this);
+    }
+
+    TeeStream(TeeStream &&tee) : TeeStream(tee) {
+    }
+
+    TeeStream &operator=(const TeeStream &) = delete;
+
+    ~TeeStream() {
+        std::lock_guard lock(shared->mutex);
+        shared->remove(this);
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        std::lock_guard lock(shared->mutex);
+        auto &sh = *shared;
+
+        if (pos >= sh.end()) {
+            sh.fill(pos, std::max(out.size(), BLOCK_SIZE));
+            if (pos >= sh.end()) {
+                return std::nullopt;
+            }
+        }
+
+        size_t r = std::min(out.size(), sh.end() - pos);
+        std::memcpy(out.data(), sh.at(pos), r * sizeof(float));
+        pos += r;
+
+        sh.trim();
+        return std::make_optional(r);
+    }
+
+    // positions near the buffered samples are just remembered, the gap is
+    // skipped by the next read. far away positions move the upstream if
+    // this is its only reader, otherwise the reader continues on a private
+    // clone of the upstream instead of making the others buffer the gap.
+    bool seek(size_t to) override {
+        std::unique_lock lock(shared->mutex);
+        auto &sh = *shared;
+
+        if (to >= sh.base && to <= sh.end() + FAR_SEEK) {
+            pos = to;
+            sh.trim();
+            return true;
+        }
+
+        if (sh.readers.size() == 1) {
+            if (!sh.upstream.seek(to)) {
+                if (to < sh.base) {
+                    return false;
+                }
+                pos = to;
+                return true;
+            }
+            sh.restart(to);
+            pos = to;
+            return true;
+        }
+
+        auto upstream = sh.upstream.clone();
+        if (!upstream.seek(to)) {
+            if (to < sh.base) {
+                return false;
+            }
+            pos = to;
+            sh.trim();
+            return true;
+        }
+
+        sh.remove(this);
+        lock.unlock();
+
+        shared = std::make_shared<Shared>(std::move(upstream));
+        shared->restart(to);
+        shared->readers.push_back(this);
+        pos = to;
+        return true;
+    }
+
+    std::optional<size_t> length() const override {
+        std::lock_guard lock(shared->mutex);
+        return shared->upstream.length();
+    }
+
+    StreamBox<float> clone() const override {
+        if (ForkScope::active()) {
+            return fork();
+        }
+        return box_stream<TeeStream>(*this);
+    }
+
+    // reader that doesn't share the upstream with the others, so nothing is
+    // buffered for them. it starts where the upstream is, which is the start
+    // until the first read. TeeStreams further up are forked too.
+    StreamBox<float> fork() const {
+        ForkScope scope;
+        std::lock_guard lock(shared->mutex);
+        return shared->upstream.clone();
+    }
+
+    // samples held for readers behind the fastest one
+    size_t buffered() const {
+        std::lock_guard lock(shared->mutex);
+        return shared->end() - shared->base;
+    }
+
+  private:
+    static constexpr size_t BLOCK_SIZE = 4096;
+    static constexpr size_t FAR_SEEK = 1 << 20;
+
+    struct Shared {
+        Shared(StreamBox<float> &&upstream)
+            : upstream(std::move(upstream)), base(0), head(0), ended(false) {
+        }
+
+        // samples [base, end()) are buffered
+        size_t end() const {
+            return base + buffer.size() - head;
+        }
+
+        const float *at(size_t p) const {
+            return buffer.data() + head + (p - base);
+        }
+
+        // reads upstream until `p` is buffered or the upstream ends. if
+        // every reader is past the buffered samples, the gap before the
+        // slowest one isn't buffered at all.
+        void fill(size_t p, size_t block) {
+            if (ended) {
+                return;
+            }
+
+            size_t lowest = slowest();
+            if (lowest > end()) {
+                size_t gap = lowest - end();
+                size_t skipped = upstream.seek(lowest) ? gap : upstream.skip(gap);
+                restart(end() + skipped);
+                if (skipped < gap) {
+                    ended = true;
+                    return;
+                }
+            }
+
+            while (p >= end()) {
+                size_t old = buffer.size();
+                buffer.resize(old + block);
+                auto r = upstream.read(std::span(buffer.data() + old, block));
+                buffer.resize(old + r.value_or(0));
+                if (!r.has_value()) {
+                    ended = true;
+                    return;
+                }
+            }
+        }
+
+        // drops samples every reader is past
+        void trim() {
+            size_t lowest = std::min(slowest(), end());
+            head += lowest - base;
+            base = lowest;
+
+            if (head > BLOCK_SIZE && head * 2 > buffer.size()) {
+                buffer.erase(buffer.begin(), buffer.begin() + head);
+                head = 0;
+            }
+        }
+
+        // the upstream was moved to `p`
+        void restart(size_t p) {
+            buffer.clear();
+            head = 0;
+            base = p;
+            ended = false;
+        }
+
+        size_t slowest() const {
+            size_t lowest = std::numeric_limits<size_t>::max();
+            for (auto reader : readers) {
+                lowest = std::min(lowest, reader->pos);
+            }
+            return lowest;
+        }
+
+        void remove(TeeStream *reader) {
+            readers.erase(std::find(readers.begin(), readers.end(), reader));
+            if (!readers.empty()) {
+                trim();
+            }
+        }
+
+        std::mutex mutex;
+        StreamBox<float> upstream;
+        std::vector<TeeStream *> readers;
+
+        std::vector<float> buffer;
+        size_t base;
+        size_t head;
+        bool ended;
+    };
+
+    std::shared_ptr<Shared> shared;
+    size_t pos;
+};
+
+#endif
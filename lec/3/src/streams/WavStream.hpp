@@ -8,6 +8,7 @@
 #include <stdexcept>
 #include <vector>
 
+#include "../misc/convert.hpp"
 #include "../streams/Stream.hpp"
 
 struct WavHeader {
@@ -24,23 +25,55 @@ struct WavHeader {
     std::uint16_t bits_per_sample;
 };
 
+// rate of everything the app renders, inputs with other rates are converted
+const std::uint32_t SAMPLE_RATE = 44100;
+
+// 16-bit mono pcm at any sample rate
+static void check_wav_header(const WavHeader &header) {
+    auto correct = std::memcmp(header.chunk_id, "RIFF", 4) == 0 &&
+                   std::memcmp(header.format, "WAVE", 4) == 0 &&
+                   std::memcmp(header.subchunk_1_id, "fmt ", 4) == 0 &&
+                   header.audio_format == 1 && header.num_channels == 1 &&
+                   header.sample_rate != 0 &&
+                   header.byte_rate == header.sample_rate * 2 &&
+                   header.block_align == 2 && header.bits_per_sample == 16;
+
+    if (!correct) {
+        throw std::runtime_error("unsupported file format");
+    }
+}
+
+// data size written by streaming encoders that can't seek back to the header
+const std::uint32_t WAV_UNKNOWN_SIZE = 0xFFFFFFFF;
+
 template <IsStream<char> S> class WavStream : public Stream<float> {
   public:
+    // reads the header right away, so the sample rate is known before the
+    // stream is wired into the graph
     WavStream(S &&stream)
-        : stream(std::move(stream)), ready(false), len(0), ended(false),
-          buffer(44100) {
+        : stream(std::move(stream)), rate(0), data_start(0),
+          len(std::nullopt), remaining(0), ended(false), buffer(44100) {
+        prepare();
     }
 
     std::optional<size_t> read(std::span<float> out) override {
-        if (!ready) {
-            prepare();
-        }
-
         if (ended) {
             return std::nullopt;
         }
 
+        if (out.size() == 0) {
+            return std::make_optional(0);
+        }
+
         size_t target_size = std::min(out.size(), buffer.size());
+        if (len.has_value()) {
+            if (remaining == 0) {
+                ended = true;
+                return std::nullopt;
+            }
+            target_size = std::min(target_size, remaining);
+            remaining -= target_size;
+        }
 
         auto r =
             stream.read_full(std::span((char *)buffer.data(), target_size * 2));
@@ -48,77 +81,98 @@ template <IsStream<char> S> class WavStream : public Stream<float> {
             ended = true;
         }
 
-        for (size_t i = 0; i < r / 2; i++) {
-            out[i] = buffer[i];
-        }
+        int16_to_float(buffer.data(), out.subspan(0, r / 2));
 
         return std::make_optional(r / 2);
     }
 
+    // works if the underlying byte stream can seek
+    bool seek(size_t pos) override {
+        if (len.has_value()) {
+            pos = std::min(pos, *len);
+        }
+        if (!stream.seek(data_start + pos * 2)) {
+            return false;
+        }
+
+        if (len.has_value()) {
+            remaining = *len - pos;
+        }
+        ended = false;
+        return true;
+    }
+
+    // unknown for streamed files until they are read to the end
     std::optional<size_t> length() const override {
-        return std::make_optional(len);
+        return len;
     }
 
     StreamBox<float> clone() const override {
         return box_stream<WavStream<S>>(*this);
     }
 
+    size_t sample_rate() const noexcept {
+        return rate;
+    }
+
   private:
     void prepare() {
         // read header
         WavHeader header;
-        auto r = stream.read(std::span((char *)&header, sizeof(header)));
+        auto r = stream.read_full(std::span((char *)&header, sizeof(header)));
         if (r < sizeof(header)) {
             throw std::runtime_error("incorrect wav file");
         }
 
-        auto correct = std::memcmp(header.chunk_id, "RIFF", 4) == 0 &&
-                       std::memcmp(header.format, "WAVE", 4) == 0 &&
-                       std::memcmp(header.subchunk_1_id, "fmt ", 4) == 0 &&
-                       header.audio_format == 1 && header.num_channels == 1 &&
-                       header.sample_rate == 44100 &&
-                       header.byte_rate == 88200 && header.block_align == 2 &&
-                       header.bits_per_sample == 16;
-
-        if (!correct) {
-            throw std::runtime_error("unsupported file format");
-        }
+        check_wav_header(header);
+        rate = header.sample_rate;
+        size_t pos = sizeof(header);
 
         // skip metadata
         while (1) {
             char id[4];
-            r = stream.read(id);
+            r = stream.read_full(id);
             if (r < sizeof(id)) {
                 throw std::runtime_error("incorrect wav file");
             }
 
             std::uint32_t size;
-            r = stream.read(std::span((char *)&size, 4));
+            r = stream.read_full(std::span((char *)&size, 4));
             if (r < sizeof(size)) {
                 throw std::runtime_error("incorrect wav file");
             }
+            pos += 8;
 
             if (std::memcmp(id, "data", 4)) {
                 r = stream.skip(size);
-                if (r < sizeof(size)) {
+                if (r < size) {
                     throw std::runtime_error("incorrect wav file");
                 }
+                pos += size;
+                continue;
+            }
+
+            data_start = pos;
+            if (size == 0 || size == WAV_UNKNOWN_SIZE) {
+                // streamed file, samples continue until the end
+                break;
             } else {
                 if (size % 2 == 1) {
                     throw std::runtime_error("incorrect wav file");
                 }
 
                 len = size / 2;
+                remaining = size / 2;
                 break;
             }
         }
-
-        ready = true;
     }
 
     S stream;
-    bool ready;
-    size_t len;
+    size_t rate;
+    size_t data_start;
+    std::optional<size_t> len;
+    size_t remaining;
     bool ended;
     std::vector<int16_t> buffer;
 };
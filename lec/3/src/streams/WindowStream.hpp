@@ -1,6 +1,8 @@
 #ifndef APP_WINDOW_STREAM_H
 #define APP_WINDOW_STREAM_H
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cmath>
 #include <complex>
@@ -8,14 +10,20 @@
 #include <cstring>
 #include <iostream>
 #include <optional>
+#include <span>
 #include <stdexcept>
 #include <vector>
 
 #include "../streams/Stream.hpp"
 
+// overlap-add of windows of `size` samples every `hop` samples, added by
+// add_window() through overlap_add(). the sum lives in a power-of-two ring
+// that is zero outside of the current window, so moving by a hop only
+// clears the hop that was just read.
 struct WindowStream : public Stream<float> {
     WindowStream(size_t size, size_t hop)
-        : output_buffer(size), hop(hop), ended(false), remaining_output(0) {
+        : size(size), hop(hop), ended(false), remaining_output(0),
+          output(std::bit_ceil(size)), mask(output.size() - 1), start(0) {
     }
 
     std::optional<size_t> read(std::span<float> out) override {
@@ -24,10 +32,10 @@ struct WindowStream : public Stream<float> {
         }
 
         if (remaining_output == 0) {
-            std::memmove(output_buffer.data(), output_buffer.data() + hop,
-                         (output_buffer.size() - hop) * sizeof(float));
-            std::memset(output_buffer.data() + output_buffer.size() - hop, 0,
-                        hop * sizeof(float));
+            each_part(start, hop, [&](size_t at, size_t n, size_t) {
+                std::memset(output.data() + at, 0, n * sizeof(float));
+            });
+            start = (start + hop) & mask;
 
             if (!add_window()) {
                 ended = true;
@@ -38,8 +46,11 @@ struct WindowStream : public Stream<float> {
 
         size_t feed = std::min(out.size(), remaining_output);
 
-        std::memcpy(out.data(), output_buffer.data() + hop - feed,
-                    feed * sizeof(float));
+        each_part(start + hop - remaining_output, feed,
+                  [&](size_t at, size_t n, size_t done) {
+                      std::memcpy(out.data() + done, output.data() + at,
+                                  n * sizeof(float));
+                  });
 
         remaining_output -= feed;
 
@@ -49,10 +60,37 @@ struct WindowStream : public Stream<float> {
     virtual bool add_window() = 0;
 
   protected:
-    std::vector<float> output_buffer;
-    size_t remaining_output;
+    // adds `size` samples to the window starting at the current hop
+    void overlap_add(const float *frame) {
+        each_part(start, size, [&](size_t at, size_t n, size_t done) {
+            float *sum = output.data() + at;
+            for (size_t i = 0; i < n; i++) {
+                sum[i] += frame[done + i];
+            }
+        });
+    }
+
+    size_t size;
     size_t hop;
     bool ended;
+    size_t remaining_output;
+
+  private:
+    // calls f(ring index, count, samples before) for the one or two
+    // contiguous parts of the n samples of the ring starting at `from`
+    template <typename F> void each_part(size_t from, size_t n, F f) {
+        from &= mask;
+        size_t first = std::min(n, output.size() - from);
+        f(from, first, 0);
+        if (first < n) {
+            f(0, n - first, first);
+        }
+    }
+
+    std::vector<float> output;
+    size_t mask;
+    // ring index of the first sample of the current hop
+    size_t start;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,7 @@
 #ifndef APP_WINDOWER_H
 #define APP_WINDOWER_H
 
+#include <bit>
 #include <cassert>
 #include <cmath>
 #include <cstring>
@@ -8,19 +9,46 @@
 
 #include "../streams/Stream.hpp"
 
+// the last `size` samples of a stream, for windows that move forward by
+// `n` samples at a time. samples live in a power-of-two ring stored twice
+// in a row, so the window is always contiguous and moving it only writes
+// the new samples.
 template <typename T> struct Windower {
-    Windower(size_t size) : buffer(size) {
+    Windower(size_t size)
+        : size(size), mask(std::bit_ceil(size) - 1), start(0),
+          ring(2 * (mask + 1)) {
     }
 
+    // moves the window by n <= size samples, returns how many could be
+    // read. the samples after those are unspecified.
     template <IsStream<T> S> size_t read_from(S &stream, size_t n) {
-        std::memmove(buffer.data(), buffer.data() + n,
-                     (buffer.size() - n) * sizeof(float));
-        size_t r =
-            stream.read_full(std::span(buffer.data() + buffer.size() - n, n));
+        assert(n <= size);
+        size_t capacity = mask + 1;
+        size_t at = (start + size) & mask;
+        size_t r = stream.read_full(std::span(ring.data() + at, n));
+
+        // copies the new samples to the other half of the ring
+        size_t lo = std::min(at + n, capacity);
+        std::memcpy(ring.data() + at + capacity, ring.data() + at,
+                    (lo - at) * sizeof(T));
+        std::memcpy(ring.data(), ring.data() + capacity,
+                    (at + n - lo) * sizeof(T));
+
+        start = (start + n) & mask;
         return r;
     }
 
-    std::vector<T> buffer;
+    // first sample of the window
+    const T *data() const {
+        return ring.data() + start;
+    }
+
+  private:
+    size_t size;
+    size_t mask;
+    // index of the first sample of the window in the ring
+    size_t start;
+    std::vector<T> ring;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,8 +1,24 @@
 #include "../src/register.hpp"
 
+#include <chrono>
+#include <cmath>
+#include <complex>
 #include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
 #include <fstream>
 #include <gtest/gtest.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 inline uint32_t rotl32(uint32_t x, int32_t bits) {
     return x << bits | x >> (32 - bits);
@@ -24,28 +40,1239 @@ void _write_to(const std::string &path, const std::vector<char> &data) {
     stream.write(data.data(), data.size());
 }
 
+const std::string VOICE = "../sounds/voice.wav";
+
+// track held in memory, seekable like a decoded file
+struct VectorStream : public Stream<float> {
+    VectorStream(std::vector<float> samples)
+        : samples(std::make_shared<const std::vector<float>>(
+              std::move(samples))),
+          pos(0) {
+    }
+
+    std::optional<size_t> read(std::span<float> out) override {
+        if (pos == samples->size()) {
+            return std::nullopt;
+        }
+        size_t r = std::min(out.size(), samples->size() - pos);
+        std::memcpy(out.data(), samples->data() + pos, r * sizeof(float));
+        pos += r;
+        return std::make_optional(r);
+    }
+
+    bool seek(size_t to) override {
+        pos = std::min(to, samples->size());
+        return true;
+    }
+
+    std::optional<size_t> length() const override {
+        return std::make_optional(samples->size());
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<VectorStream>(*this);
+    }
+
+  private:
+    std::shared_ptr<const std::vector<float>> samples;
+    size_t pos;
+};
+
+// reads the stream to the end in blocks of `block` samples
+std::vector<float> read_all(Stream<float> &stream, size_t block = 1000) {
+    std::vector<float> result;
+    std::vector<float> buffer(block);
+    while (auto r = stream.read(buffer)) {
+        result.insert(result.end(), buffer.begin(), buffer.begin() + *r);
+    }
+    return result;
+}
+
+// deterministic noise in the int16 range
+std::vector<float> noise(size_t n, uint32_t seed = 1) {
+    std::vector<float> result(n);
+    for (auto &x : result) {
+        seed = seed * 1664525 + 1013904223;
+        x = (float)(int16_t)(seed >> 16);
+    }
+    return result;
+}
+
+TEST(MmapWavStream, MatchesBufferedDecoder) {
+    MmapWavStream mapped{MmapFileStream(VOICE)};
+    WavStream<FileStream> buffered{FileStream(VOICE)};
+
+    ASSERT_EQ(mapped.length(), buffered.length());
+    auto samples = read_all(buffered);
+    ASSERT_EQ(read_all(mapped, 777), samples);
+
+    ASSERT_TRUE(mapped.seek(12345));
+    auto rest = read_all(mapped);
+    ASSERT_EQ(rest, std::vector<float>(samples.begin() + 12345, samples.end()));
+}
+
+// every kernel the cpu runs against the scalar ones, on lengths that leave
+// a tail after the vector loop and on values that have to saturate
+TEST(Convert, KernelsMatchScalar) {
+    std::vector<ConvertKernels> kernels{convert_kernels()};
+#ifdef APP_CONVERT_X86
+    kernels.push_back({int16_to_float_sse2, float_to_int16_sse2,
+                       float_to_int16_dither_sse2});
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({int16_to_float_avx2, float_to_int16_avx2,
+                           float_to_int16_dither_avx2});
+    }
+#endif
+
+    auto samples = noise(100);
+    for (auto &x : samples) {
+        x *= 1.5f;
+    }
+    samples[3] = 32767.4f;
+    samples[4] = -32768.9f;
+    samples[5] = 1e9f;
+    samples[6] = -1e9f;
+    samples[7] = -0.7f;
+
+    std::vector<float> dither(samples.size());
+    TpdfDither(7).fill(dither);
+
+    std::vector<int16_t> ints(samples.size());
+    float_to_int16_scalar(samples.data(), ints.data(), samples.size());
+
+    for (auto &k : kernels) {
+        for (size_t n = 0; n <= samples.size(); n += n < 40 ? 1 : 30) {
+            std::vector<float> f(n, -1.f);
+            std::vector<float> expected_f(n, -1.f);
+            k.to_float(ints.data(), f.data(), n);
+            int16_to_float_scalar(ints.data(), expected_f.data(), n);
+            ASSERT_EQ(f, expected_f) << n;
+
+            std::vector<int16_t> i(n), expected_i(n);
+            k.to_int16(samples.data(), i.data(), n);
+            float_to_int16_scalar(samples.data(), expected_i.data(), n);
+            ASSERT_EQ(i, expected_i) << n;
+
+            k.to_int16_dither(samples.data(), dither.data(), i.data(), n);
+            float_to_int16_dither_scalar(samples.data(), dither.data(),
+                                         expected_i.data(), n);
+            ASSERT_EQ(i, expected_i) << n;
+        }
+    }
+}
+
+// threads change where the work is done, not the result
+TEST(PipeStream, SameOutputAsUnthreaded) {
+    auto app = create_app();
+    std::vector<std::string> in_paths{VOICE, VOICE};
+
+    auto expected = app.run_collect("mute 1 2\n"
+                                    "gain 50%\n"
+                                    "resample 150%\n"
+                                    "mix $2 1\n",
+                                    in_paths);
+    auto piped = app.run_collect("mute 1 2\n"
+                                 "pipeline\n"
+                                 "gain 50%\n"
+                                 "resample 150%\n"
+                                 "pipeline\n"
+                                 "mix $2 1\n",
+                                 in_paths);
+    ASSERT_EQ(piped, expected);
+
+    RenderOptions options;
+    options.jobs = 4;
+    auto threaded = app.run_collect("mute 1 2\n"
+                                    "gain 50%\n"
+                                    "resample 150%\n"
+                                    "mix $2 1\n",
+                                    in_paths, options);
+    ASSERT_EQ(threaded, expected);
+}
+
+TEST(PipeStream, CloneWhileRunning) {
+    auto samples = noise(50000);
+    for (size_t at : {0, 1, 999, 2500, 7000, 49999, 50000}) {
+        PipeStream pipe(box_stream<VectorStream>(samples), 4, 1000);
+        std::vector<float> head(at);
+        ASSERT_EQ(pipe.read_full(head), at);
+
+        auto clone = pipe.clone();
+        std::vector<float> rest(samples.begin() + at, samples.end());
+        ASSERT_EQ(read_all(clone, 333), rest) << at;
+        ASSERT_EQ(read_all(pipe), rest) << at;
+    }
+}
+
+// transform with the conventions of FftPlan, computed directly in double
+std::vector<std::complex<double>>
+naive_dft(const std::vector<std::complex<float>> &a) {
+    size_t n = a.size();
+    std::vector<std::complex<double>> result(n);
+    for (size_t k = 0; k < n; k++) {
+        for (size_t m = 0; m < n; m++) {
+            double ang = 2. * M_PI * (double)(k * m % n) / (double)n;
+            result[k] += std::complex<double>(a[m]) *
+                         std::complex<double>(std::cos(ang), std::sin(ang));
+        }
+    }
+    return result;
+}
+
+std::vector<std::complex<float>> complex_noise(size_t n, uint32_t seed) {
+    auto values = noise(2 * n, seed);
+    std::vector<std::complex<float>> result(n);
+    for (size_t i = 0; i < n; i++) {
+        result[i] = {values[2 * i] / 32768.f, values[2 * i + 1] / 32768.f};
+    }
+    return result;
+}
+
+TEST(Fft, MatchesNaiveDft) {
+    for (size_t n : {1, 2, 4, 8, 16, 32, 64, 256, 1024}) {
+        auto input = complex_noise(n, n);
+        auto expected = naive_dft(input);
+
+        auto a = input;
+        FftPlan::get(n)->execute(a, false);
+        for (size_t k = 0; k < n; k++) {
+            ASSERT_NEAR(a[k].real(), expected[k].real(), 1e-6 * n) << n;
+            ASSERT_NEAR(a[k].imag(), expected[k].imag(), 1e-6 * n) << n;
+        }
+
+        FftPlan::get(n)->execute(a, true);
+        for (size_t k = 0; k < n; k++) {
+            ASSERT_NEAR(a[k].real(), input[k].real(), 1e-5) << n;
+            ASSERT_NEAR(a[k].imag(), input[k].imag(), 1e-5) << n;
+        }
+    }
+}
+
+// real transforms against the complex DFT of the same signals, and the
+// inverse back to the signal
+TEST(RealFft, MatchesNaiveDft) {
+    for (size_t n : {2, 4, 8, 16, 64, 1024}) {
+        auto plan = RealFftPlan::get(n);
+        auto x = complex_noise(n, n);
+        auto y = x;
+        for (size_t m = 0; m < n; m++) {
+            y[m] = x[m].imag();
+            x[m] = x[m].real();
+        }
+        auto expected_x = naive_dft(x);
+        auto expected_y = naive_dft(y);
+
+        std::vector<std::complex<float>> a(n / 2 + 1);
+        auto samples = RealFftPlan::samples(a);
+        for (size_t m = 0; m < n; m++) {
+            samples[m] = x[m].real();
+        }
+        plan->forward(a);
+        for (size_t k = 0; k <= n / 2; k++) {
+            ASSERT_NEAR(a[k].real(), expected_x[k].real(), 1e-6 * n) << n;
+            ASSERT_NEAR(a[k].imag(), expected_x[k].imag(), 1e-6 * n) << n;
+        }
+
+        plan->inverse(a);
+        for (size_t m = 0; m < n; m++) {
+            ASSERT_NEAR(samples[m], x[m].real(), 1e-5) << n;
+        }
+
+        std::vector<std::complex<float>> b(n + 2);
+        for (size_t m = 0; m < n; m++) {
+            b[m] = {x[m].real(), y[m].real()};
+        }
+        plan->forward2(b);
+        for (size_t k = 0; k <= n / 2; k++) {
+            auto &bx = b[k];
+            auto &by = b[n / 2 + 1 + k];
+            ASSERT_NEAR(bx.real(), expected_x[k].real(), 1e-6 * n) << n;
+            ASSERT_NEAR(bx.imag(), expected_x[k].imag(), 1e-6 * n) << n;
+            ASSERT_NEAR(by.real(), expected_y[k].real(), 1e-6 * n) << n;
+            ASSERT_NEAR(by.imag(), expected_y[k].imag(), 1e-6 * n) << n;
+        }
+    }
+}
+
+// windows of sizes that do and don't fill the ring, moved by different
+// amounts so they wrap around it at every offset
+TEST(Windower, LastSamplesAfterWrapping) {
+    auto samples = noise(5000);
+    for (size_t size : {1, 5, 8, 100}) {
+        Windower<float> windower(size);
+        VectorStream stream(samples);
+        // the window starts out as zeros
+        std::vector<float> seen(size, 0.f);
+        for (size_t i = 0; seen.size() + size < samples.size(); i++) {
+            size_t n = 1 + i * 7 % size;
+            ASSERT_EQ(windower.read_from(stream, n), n);
+            seen.insert(seen.end(), samples.begin() + seen.size() - size,
+                        samples.begin() + seen.size() - size + n);
+            ASSERT_EQ(std::vector<float>(windower.data(),
+                                         windower.data() + size),
+                      std::vector<float>(seen.end() - size, seen.end()))
+                << size << " " << i;
+        }
+    }
+}
+
+// adds `count` windows of known samples
+struct TestWindowStream : public WindowStream {
+    TestWindowStream(size_t size, size_t hop, size_t count)
+        : WindowStream(size, hop), count(count), added(0) {
+    }
+
+    static float sample(size_t window, size_t i) {
+        return (float)(window * 7 + i % 5);
+    }
+
+    bool add_window() override {
+        if (added == count) {
+            return false;
+        }
+        std::vector<float> frame(size);
+        for (size_t i = 0; i < size; i++) {
+            frame[i] = sample(added, i);
+        }
+        overlap_add(frame.data());
+        added++;
+        return true;
+    }
+
+    StreamBox<float> clone() const override {
+        return box_stream<TestWindowStream>(*this);
+    }
+
+    size_t count;
+    size_t added;
+};
+
+// a hop of output for every window, the sum of all windows over it
+TEST(WindowStream, OverlapAddAfterWrapping) {
+    for (auto [size, hop] : {std::pair<size_t, size_t>{6, 2},
+                             {8, 3},
+                             {5, 5},
+                             {1024, 256},
+                             {1000, 300}}) {
+        size_t count = 50;
+        std::vector<float> expected(count * hop + size);
+        for (size_t w = 0; w < count; w++) {
+            for (size_t i = 0; i < size; i++) {
+                expected[w * hop + i] += TestWindowStream::sample(w, i);
+            }
+        }
+        expected.resize(count * hop);
+
+        for (size_t block : {1, 3, 1000}) {
+            TestWindowStream stream(size, hop, count);
+            ASSERT_EQ(read_all(stream, block), expected)
+                << size << " " << hop << " " << block;
+        }
+    }
+}
+
+// stages fused into one node against the same stages as separate streams,
+// with a mute long enough that the fused node skips reading the source
+TEST(FusedStream, SameOutputAsUnfused) {
+    auto samples = noise(100000);
+    std::vector<MuteRange> first{
+        {.start = 100, .end = 200},
+        {.start = 5000, .end = 30000, .before = {.length = 300}},
+    };
+    std::vector<MuteRange> second{
+        {.start = 20000,
+         .end = 60000,
+         .after = {.length = 1000, .shape = FadeShape::cosine}},
+    };
+
+    using Source = StreamBox<float>;
+    MuteStream<GainStream<MuteStream<GainStream<Source>>>> unfused(
+        GainStream<MuteStream<GainStream<Source>>>(
+            MuteStream<GainStream<Source>>(
+                GainStream<Source>(box_stream<VectorStream>(samples), 0.5f),
+                first),
+            1.25f),
+        second);
+    auto expected = read_all(unfused);
+
+    StreamBox<float> fused = box_stream<VectorStream>(samples);
+    fuse(fused, GainKernel{.gain = 0.5f});
+    fuse(fused, MuteKernel(first));
+    fuse(fused, GainKernel{.gain = 1.25f});
+    fuse(fused, MuteKernel(second));
+    ASSERT_NE(fused.as<PointwiseStream>(), nullptr);
+    ASSERT_EQ(read_all(fused, 777), expected);
+}
+
+// renders the samples into `output` as write_wav_stream does for files
+void write_samples(OutputWriter &output, const std::vector<float> &samples) {
+    VectorStream stream(samples);
+    write_wav_stream(output, stream, {}, [](size_t, std::optional<size_t>) {});
+}
+
+// the RIFF and data sizes of a rendered file starting at `at`
+std::pair<uint32_t, uint32_t> wav_sizes(const std::vector<char> &data,
+                                        size_t at = 0) {
+    WavHeader header;
+    std::memcpy(&header, data.data() + at, sizeof(header));
+    uint32_t size;
+    std::memcpy(&size, data.data() + at + sizeof(header) + 4, 4);
+    return {header.chunk_size, size};
+}
+
+std::vector<char> read_fd(int fd) {
+    std::vector<char> result;
+    char buffer[4096];
+    ssize_t r;
+    while ((r = ::read(fd, buffer, sizeof(buffer))) > 0) {
+        result.insert(result.end(), buffer, buffer + r);
+    }
+    return result;
+}
+
+// temporary file removed at the end of the test
+struct TempFile {
+    TempFile() {
+        char name[] = "/tmp/app_test_XXXXXX";
+        fd = ::mkstemp(name);
+        path = name;
+    }
+
+    ~TempFile() {
+        ::close(fd);
+        std::filesystem::remove(path);
+    }
+
+    std::vector<char> content() const {
+        int in = ::open(path.c_str(), O_RDONLY);
+        auto data = read_fd(in);
+        ::close(in);
+        return data;
+    }
+
+    int fd;
+    std::string path;
+};
+
+TEST(WavOutput, SeekableOutputGetsSizes) {
+    auto samples = noise(30000);
+    VectorOutputWriter writer;
+    write_samples(writer, samples);
+    auto data = writer.to_vector();
+
+    ASSERT_EQ(data.size(), 44 + 2 * samples.size());
+    ASSERT_EQ(wav_sizes(data), std::make_pair(uint32_t(36 + 2 * 30000),
+                                              uint32_t(2 * 30000)));
+}
+
+// a pipe, like stdout when the output is "-"
+TEST(WavOutput, PipeGetsUnknownSizes) {
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+
+    // small enough to fit into the pipe buffer
+    auto samples = noise(1000);
+    {
+        FdOutputWriter writer(fds[1]);
+        ASSERT_FALSE(writer.seekable());
+        write_samples(writer, samples);
+    }
+    ::close(fds[1]);
+    auto data = read_fd(fds[0]);
+    ::close(fds[0]);
+
+    ASSERT_EQ(data.size(), 44 + 2 * samples.size());
+    ASSERT_EQ(wav_sizes(data),
+              std::make_pair(WAV_UNKNOWN_SIZE, WAV_UNKNOWN_SIZE));
+
+    int in[2];
+    ASSERT_EQ(::pipe(in), 0);
+    ASSERT_EQ(::write(in[1], data.data(), data.size()), (ssize_t)data.size());
+    ::close(in[1]);
+    WavStream<FdStream> wav{FdStream(in[0])};
+    ASSERT_EQ(wav.length(), std::nullopt);
+    ASSERT_EQ(read_all(wav), samples);
+    ::close(in[0]);
+}
+
+// `>` into a file that already has something before the output
+TEST(WavOutput, FdSeeksFromStartingOffset) {
+    TempFile file;
+    ASSERT_EQ(::write(file.fd, "0123456789", 10), 10);
+
+    auto samples = noise(3000);
+    FdOutputWriter writer(file.fd);
+    ASSERT_TRUE(writer.seekable());
+    write_samples(writer, samples);
+
+    auto data = file.content();
+    ASSERT_EQ(data.size(), 10 + 44 + 2 * samples.size());
+    ASSERT_EQ(std::string(data.data(), 10), "0123456789");
+    ASSERT_EQ(std::string(data.data() + 10, 4), "RIFF");
+    ASSERT_EQ(wav_sizes(data, 10), std::make_pair(uint32_t(36 + 2 * 3000),
+                                                  uint32_t(2 * 3000)));
+}
+
+// `>>` writes at the end whatever the position is
+TEST(WavOutput, AppendingFdGetsUnknownSizes) {
+    TempFile file;
+    ASSERT_EQ(::write(file.fd, "0123456789", 10), 10);
+    int fd = ::open(file.path.c_str(), O_WRONLY | O_APPEND);
+    ::lseek(fd, 0, SEEK_SET);
+
+    auto samples = noise(3000);
+    {
+        FdOutputWriter writer(fd);
+        ASSERT_FALSE(writer.seekable());
+        write_samples(writer, samples);
+    }
+    ::close(fd);
+
+    auto data = file.content();
+    ASSERT_EQ(data.size(), 10 + 44 + 2 * samples.size());
+    ASSERT_EQ(std::string(data.data(), 10), "0123456789");
+    ASSERT_EQ(wav_sizes(data, 10),
+              std::make_pair(WAV_UNKNOWN_SIZE, WAV_UNKNOWN_SIZE));
+}
+
+// writes a rendered file and some patches over earlier buffers through
+// both writers, with buffers small enough that the data spans many
+void check_async_output(bool uring, size_t buffer_size) {
+    auto samples = noise(20000, 7);
+    std::vector<char> patch(5000, 'x');
+    auto write = [&](OutputWriter &writer) {
+        write_samples(writer, samples);
+        writer.seek(10);
+        writer.write(patch.data(), patch.size());
+        writer.seek(3 * buffer_size - 100);
+        writer.write(patch.data(), 200);
+        writer.flush();
+    };
+
+    TempFile expected;
+    {
+        FileOutputWriter writer(expected.path);
+        write(writer);
+    }
+
+    TempFile file;
+    {
+        AsyncOutputWriter writer(file.path, 2, buffer_size, uring);
+        if (uring && !writer.uring()) {
+            GTEST_SKIP() << "io_uring isn't available";
+        }
+        write(writer);
+    }
+    ASSERT_EQ(file.content().size(), 44 + 2 * samples.size());
+    ASSERT_EQ(file.content(), expected.content());
+}
+
+TEST(AsyncOutput, ThreadWritesSameBytes) {
+    check_async_output(false, 4096);
+    check_async_output(false, 1000);
+}
+
+TEST(AsyncOutput, UringWritesSameBytes) {
+    check_async_output(true, 4096);
+    check_async_output(true, 1000);
+}
+
+// errors of the background writes come out of write() or flush()
+TEST(AsyncOutput, ReportsWriteErrors) {
+    if (::access("/dev/full", W_OK) != 0) {
+        GTEST_SKIP() << "no /dev/full";
+    }
+    for (bool uring : {false, true}) {
+        std::vector<char> data(3 * 4096);
+        AsyncOutputWriter writer("/dev/full", 2, 4096, uring);
+        try {
+            writer.write(data.data(), data.size());
+            writer.flush();
+            FAIL() << "no error";
+        } catch (const std::system_error &e) {
+            ASSERT_EQ(e.code().value(), ENOSPC);
+        }
+    }
+}
+
+std::vector<float> sine(size_t n, double freq, double amplitude = 10000.) {
+    std::vector<float> result(n);
+    for (size_t i = 0; i < n; i++) {
+        result[i] = (float)(amplitude *
+                            std::sin(2. * M_PI * freq * (double)i / 44100.));
+    }
+    return result;
+}
+
+// frequency in Hz from the rising zero crossings of the middle half of a
+// sine, each one placed between its two samples
+double sine_frequency(const std::vector<float> &samples) {
+    std::vector<double> crossings;
+    for (size_t i = samples.size() / 4; i < samples.size() * 3 / 4; i++) {
+        if (samples[i - 1] < 0.f && samples[i] >= 0.f) {
+            double t = samples[i - 1] / (samples[i - 1] - samples[i]);
+            crossings.push_back((double)(i - 1) + t);
+        }
+    }
+    if (crossings.size() < 2) {
+        return 0.;
+    }
+    return (double)(crossings.size() - 1) /
+           (crossings.back() - crossings.front()) * 44100.;
+}
+
+// resample p% gives p / 100 times as many samples
+TEST(ResampleStream, Length) {
+    for (size_t percent : {1, 50, 75, 99, 100, 101, 150, 200, 333}) {
+        for (size_t n : {0, 1, 2, 999, 4097, 44100}) {
+            ResampleStream<StreamBox<float>> resampled(
+                box_stream<VectorStream>(noise(n)), percent, 100);
+            ASSERT_EQ(resampled.length(), n * percent / 100);
+            ASSERT_EQ(read_all(resampled, 777).size(), n * percent / 100)
+                << percent << "% of " << n;
+        }
+    }
+}
+
+// a track slowed down to p% has its pitch divided by p / 100
+TEST(ResampleStream, SineFrequency) {
+    auto input = sine(44100, 440.);
+    for (size_t percent : {50, 75, 150, 200, 300}) {
+        ResampleStream<StreamBox<float>> resampled(
+            box_stream<VectorStream>(input), percent, 100);
+        auto output = read_all(resampled);
+        double expected = 440. * 100. / (double)percent;
+        ASSERT_NEAR(sine_frequency(output), expected, expected * 1e-4)
+            << percent;
+    }
+}
+
+// samples of a rendered file, after the 44 bytes of header
+std::vector<char> wav_data(const std::vector<char> &file) {
+    return std::vector<char>(file.begin() + 44, file.end());
+}
+
+// a range is the same part of the full render, wherever the graph could
+// seek instead of rendering the part before it
+TEST(Range, SameAsPartOfFullRender) {
+    auto app = create_app();
+    std::vector<std::string> in_paths{VOICE, VOICE};
+    for (auto config : {"mute 1 2\ngain 50%",
+                        "resample 150%\nmix $2 1",
+                        "mix $2 1\nvocoder $2"}) {
+        auto full = wav_data(app.run_collect(config, in_paths));
+        for (auto [start, end] : {std::pair<size_t, size_t>{0, 1000},
+                                  {44100, 3 * 44100},
+                                  {100000, 100001},
+                                  {300000, 1000000}}) {
+            RenderOptions options;
+            options.range_start = start;
+            options.range_end = end;
+            auto part = wav_data(app.run_collect(config, in_paths, options));
+            size_t from = std::min(2 * start, full.size());
+            size_t to = std::min(2 * end, full.size());
+            ASSERT_EQ(part, std::vector<char>(full.begin() + from,
+                                              full.begin() + to))
+                << config << " " << start;
+        }
+    }
+}
+
+TEST(ResampleStream, SeekSameAsReading) {
+    auto samples = noise(20000);
+    for (size_t percent : {33, 150, 200}) {
+        ResampleStream<StreamBox<float>> full(
+            box_stream<VectorStream>(samples), percent, 100);
+        auto expected = read_all(full);
+        size_t n = expected.size();
+        for (size_t pos : {size_t(0), size_t(1), size_t(50), n / 2, n - 1, n}) {
+            ResampleStream<StreamBox<float>> seeked(
+                box_stream<VectorStream>(samples), percent, 100);
+            ASSERT_TRUE(seeked.seek(pos));
+            ASSERT_EQ(read_all(seeked),
+                      std::vector<float>(expected.begin() + pos,
+                                         expected.end()))
+                << percent << "% at " << pos;
+        }
+    }
+}
+
+// readers at different speeds all get the whole track, one of them created
+// after the others already read part of it
+TEST(TeeStream, SeveralReaders) {
+    auto samples = noise(100000);
+    StreamBox<float> first = box_stream<TeeStream>(
+        box_stream<VectorStream>(samples));
+    auto second = first.clone();
+
+    std::vector<float> a, b, c;
+    std::vector<float> buffer(1000);
+    auto step = [&](StreamBox<float> &reader, std::vector<float> &out,
+                    size_t n) {
+        auto r = reader.read(std::span(buffer.data(), n));
+        if (r.has_value()) {
+            out.insert(out.end(), buffer.begin(), buffer.begin() + *r);
+        }
+        return r.has_value();
+    };
+
+    for (size_t i = 0; i < 10; i++) {
+        step(first, a, 1000);
+    }
+    auto third = first.clone();
+    c = a;
+
+    bool more = true;
+    while (more) {
+        more = step(first, a, 100);
+        more = step(second, b, 333) || more;
+        more = step(third, c, 1000) || more;
+    }
+    ASSERT_EQ(a, samples);
+    ASSERT_EQ(b, samples);
+    ASSERT_EQ(c, samples);
+}
+
+TEST(TeeStream, ReadersOnThreads) {
+    auto samples = noise(300000);
+    StreamBox<float> tee = box_stream<TeeStream>(
+        box_stream<VectorStream>(samples));
+
+    std::vector<StreamBox<float>> readers;
+    for (size_t i = 0; i < 4; i++) {
+        readers.push_back(tee.clone());
+    }
+    std::vector<std::vector<float>> results(readers.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < readers.size(); i++) {
+        threads.emplace_back(
+            [&, i]() { results[i] = read_all(readers[i], 100 + 300 * i); });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto &result : results) {
+        ASSERT_EQ(result, samples);
+    }
+    ASSERT_EQ(read_all(tee), samples);
+}
+
+// a reader seeking far ahead continues on its own upstream, the others
+// aren't affected
+TEST(TeeStream, FarSeek) {
+    auto samples = noise(3000000);
+    StreamBox<float> first = box_stream<TeeStream>(
+        box_stream<VectorStream>(samples));
+    auto second = first.clone();
+
+    std::vector<float> head(5000);
+    ASSERT_EQ(second.read_full(head), head.size());
+
+    ASSERT_TRUE(first.seek(2500000));
+    ASSERT_EQ(read_all(first),
+              std::vector<float>(samples.begin() + 2500000, samples.end()));
+
+    ASSERT_TRUE(second.seek(10));
+    ASSERT_EQ(read_all(second),
+              std::vector<float>(samples.begin() + 10, samples.end()));
+}
+
+// gain of sample `i` of a track muted by `range` alone
+float mute_gain(const MuteRange &range, size_t i) {
+    auto gain = [](const Fade &fade, size_t k, bool rising) {
+        double t = (double)(k + 1) / (double)(fade.length + 1);
+        if (!rising) {
+            t = 1. - t;
+        }
+        if (fade.shape == FadeShape::cosine) {
+            t = 0.5 - 0.5 * std::cos(M_PI * t);
+        }
+        return (float)t;
+    };
+    if (i >= range.start && i < range.end) {
+        return 0.f;
+    }
+    if (i < range.start && i + range.before.length >= range.start) {
+        return gain(range.before, i + range.before.length - range.start,
+                    false);
+    }
+    if (i >= range.end && i < range.end + range.after.length) {
+        return gain(range.after, i - range.end, true);
+    }
+    return 1.f;
+}
+
+// ranges with fades of both shapes, one fading out from before the track
+// starts and one running past its end, read in blocks that cut through the
+// fades at different places
+TEST(MuteStream, MatchesPerSampleGain) {
+    auto samples = noise(50000);
+    std::vector<MuteRange> ranges{
+        {100, 200, {300, FadeShape::linear}, {50, FadeShape::cosine}},
+        {1000, 1001, {}, {}},
+        {5000, 20000, {1000, FadeShape::cosine}, {999, FadeShape::linear}},
+        {21000, 21500, {}, {7, FadeShape::linear}},
+        {49990, 60000, {100, FadeShape::cosine}, {}},
+    };
+
+    auto expected = samples;
+    for (size_t i = 0; i < expected.size(); i++) {
+        for (auto &range : ranges) {
+            if (auto gain = mute_gain(range, i); gain != 1.f) {
+                expected[i] = gain == 0.f ? 0.f : expected[i] * gain;
+            }
+        }
+    }
+
+    for (size_t block : {1, 7, 1000, 44100}) {
+        MuteStream<StreamBox<float>> stream(box_stream<VectorStream>(samples),
+                                            ranges);
+        ASSERT_EQ(read_all(stream, block), expected) << block;
+    }
+
+    MuteStream<StreamBox<float>> stream(box_stream<VectorStream>(samples),
+                                        ranges);
+    for (size_t pos : {4500, 5000, 19999, 20500, 49000}) {
+        ASSERT_TRUE(stream.seek(pos));
+        ASSERT_EQ(read_all(stream, 333),
+                  std::vector<float>(expected.begin() + pos, expected.end()))
+            << pos;
+    }
+
+    MuteKernel kernel(ranges);
+    for (auto &range : ranges) {
+        ASSERT_EQ(kernel.silent_until(range.start - 1), range.start - 1);
+        ASSERT_EQ(kernel.silent_until(range.start), range.end);
+        ASSERT_EQ(kernel.silent_until(range.end - 1), range.end);
+        ASSERT_EQ(kernel.silent_until(range.end), range.end);
+    }
+}
+
+// inputs overlapping each other, one running past the end of the main
+// track and one starting after it, against summing every sample in turn
+TEST(MixBusStream, MatchesPerSampleSum) {
+    auto main = noise(30000);
+    std::vector<std::vector<float>> tracks{
+        noise(10000, 2), noise(20000, 3), noise(40000, 4), noise(100, 5)};
+    std::vector<size_t> insert_at{0, 5000, 25000, 35000};
+    std::vector<float> gains{1.f, 0.5f, 2.f, 1.f};
+
+    auto expected = main;
+    for (size_t i = 0; i < expected.size(); i++) {
+        int count = 1;
+        for (size_t j = 0; j < tracks.size(); j++) {
+            if (i >= insert_at[j] && i - insert_at[j] < tracks[j].size()) {
+                expected[i] += gains[j] * tracks[j][i - insert_at[j]];
+                count++;
+            }
+        }
+        if (count > 1) {
+            expected[i] *= 1.f / (float)count;
+        }
+    }
+
+    auto make = [&]() {
+        std::vector<MixInput<StreamBox<float>>> inputs;
+        for (size_t j = 0; j < tracks.size(); j++) {
+            inputs.push_back({box_stream<VectorStream>(tracks[j]),
+                              insert_at[j], gains[j]});
+        }
+        return MixBusStream<StreamBox<float>, StreamBox<float>>(
+            box_stream<VectorStream>(main), std::move(inputs));
+    };
+
+    for (size_t block : {1, 999, 44100}) {
+        auto stream = make();
+        ASSERT_EQ(read_all(stream, block), expected) << block;
+    }
+
+    auto stream = make();
+    for (size_t pos : {20000, 100, 4999, 29999}) {
+        ASSERT_TRUE(stream.seek(pos));
+        ASSERT_EQ(read_all(stream, 777),
+                  std::vector<float>(expected.begin() + pos, expected.end()))
+            << pos;
+    }
+
+    auto app = create_app();
+    ASSERT_EQ(app.compile("mix $2 $3 1 50% $4 2").size(), 1);
+}
+
+// partitioned convolution against summing the products directly, with
+// responses shorter than, as long as and longer than a partition
+TEST(ConvolveStream, MatchesDirectConvolution) {
+    for (auto [length, response_length, block] :
+         {std::tuple<size_t, size_t, size_t>{1000, 1, 16},
+          {1000, 16, 16},
+          {1000, 17, 16},
+          {1, 100, 16},
+          {20000, 3000, 1024}}) {
+        auto a = noise(length, 1);
+        auto b = noise(response_length, 2);
+        for (auto &x : b) {
+            x *= 0.01f;
+        }
+
+        std::vector<double> expected(length + response_length - 1);
+        double peak = 0.;
+        for (size_t i = 0; i < length; i++) {
+            for (size_t k = 0; k < response_length; k++) {
+                expected[i + k] += (double)a[i] * b[k] / 32768.;
+            }
+        }
+        for (auto y : expected) {
+            peak = std::max(peak, std::abs(y));
+        }
+
+        ConvolveStream<StreamBox<float>, StreamBox<float>> stream(
+            box_stream<VectorStream>(a), box_stream<VectorStream>(b), block);
+        ASSERT_EQ(stream.length(), expected.size());
+        auto result = read_all(stream, 777);
+        ASSERT_EQ(result.size(), expected.size());
+        for (size_t i = 0; i < result.size(); i++) {
+            ASSERT_NEAR(result[i], expected[i], 1e-5 * peak)
+                << length << " " << response_length << " at " << i;
+        }
+    }
+}
+
+TEST(ConvolveStream, EmptyResponse) {
+    ConvolveStream<StreamBox<float>, StreamBox<float>> stream(
+        box_stream<VectorStream>(noise(100)),
+        box_stream<VectorStream>(std::vector<float>()), 16);
+    ASSERT_EQ(stream.length(), std::nullopt);
+    std::vector<float> buffer(10);
+    ASSERT_THROW(stream.read(buffer), std::runtime_error);
+
+    TempFile empty;
+    FdOutputWriter output(empty.fd);
+    write_samples(output, {});
+    auto app = create_app();
+    ASSERT_THROW(app.get_output_stream("convolve $2", {VOICE, empty.path}),
+                 std::runtime_error);
+}
+
+// the kernel's groups of four sections against running the sections one
+// after another, fed in blocks of 0 to 5 samples so every block is shorter
+// than the wavefront and state carries over between them
+TEST(BiquadKernel, MatchesScalarCascade) {
+    std::vector<Biquad> all{
+        Biquad::lowpass(3000., 0.707),
+        Biquad::highpass(100., 1.),
+        Biquad::peak(1000., 6., 2.),
+        Biquad::low_shelf(200., -4., 0.7),
+        Biquad::high_shelf(8000., 3., 0.7),
+        Biquad::lowpass(12000., 0.5),
+        Biquad::peak(400., -9., 4.),
+        Biquad::highpass(30., 0.707),
+        Biquad::peak(2500., 2., 1.),
+    };
+    auto samples = noise(3000);
+
+    for (size_t count = 1; count <= all.size(); count++) {
+        std::vector<Biquad> sections(all.begin(), all.begin() + count);
+
+        auto expected = samples;
+        for (auto &s : sections) {
+            float z1 = 0.f;
+            float z2 = 0.f;
+            for (auto &x : expected) {
+                float y = s.b0 * x + z1;
+                z1 = s.b1 * x - s.a1 * y + z2;
+                z2 = s.b2 * x - s.a2 * y;
+                x = y;
+            }
+        }
+
+        auto result = samples;
+        BiquadKernel kernel(sections);
+        for (size_t at = 0, i = 0; at < result.size(); i++) {
+            size_t n = std::min(i % 6, result.size() - at);
+            kernel.process(std::span(result.data() + at, n), at, {});
+            at += n;
+        }
+        ASSERT_EQ(result, expected) << count;
+    }
+}
+
+// a 1 kHz sine reads 3.01 dB below its peak level in LUFS (bs.1770), so
+// this one is at -23 LUFS
+TEST(Loudness, ReferenceTone) {
+    double amplitude = std::pow(10., (-23. + 3.01) / 20.);
+    StreamBox<float> tone =
+        box_stream<VectorStream>(sine(20 * 44100, 1000., amplitude * 32768.));
+    auto loudness = measure_loudness(tone, nullptr, false);
+    ASSERT_NEAR(loudness.lufs, -23., 0.1);
+    ASSERT_NEAR(loudness.peak, amplitude, 1e-4);
+    ASSERT_NEAR(loudness.rms, amplitude / std::sqrt(2.), 1e-4);
+
+    StreamBox<float> silence =
+        box_stream<VectorStream>(std::vector<float>(44100));
+    ASSERT_EQ(measure_loudness(silence, nullptr, false).lufs,
+              -std::numeric_limits<double>::infinity());
+}
+
+// chunks measured on the pool against one pass over the track, on a track
+// with quiet parts for the gates to drop
+TEST(Loudness, ParallelSameAsSerial) {
+    auto samples = noise(200 * 44100);
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] *= (i / 44100 % 7 == 0) ? 0.001f : 0.3f + 0.1f * (i % 3);
+    }
+    ThreadPool pool(3);
+    StreamBox<float> track = box_stream<VectorStream>(samples);
+    auto serial = measure_loudness(track, nullptr, false);
+    auto parallel = measure_loudness(track, &pool, false);
+    ASSERT_EQ(parallel.peak, serial.peak);
+    ASSERT_NEAR(parallel.rms, serial.rms, 1e-9);
+    ASSERT_NEAR(parallel.lufs, serial.lufs, 1e-3);
+}
+
+// normalize after `mix $2`: the measured track is a shared slot with
+// another shared slot mixed into it. the analysis reads private copies of
+// both, so neither buffers the track for the readers that haven't started.
+TEST(Loudness, SharedSlotsNotBuffered) {
+    using Mix = MixBusStream<StreamBox<float>, StreamBox<float>>;
+    auto a = noise(30 * 44100, 1);
+    auto b = noise(30 * 44100, 2);
+    auto mix = [&](StreamBox<float> second) {
+        std::vector<MixInput<StreamBox<float>>> inputs;
+        inputs.push_back({.stream = std::move(second)});
+        return box_stream<Mix>(box_stream<VectorStream>(a), std::move(inputs));
+    };
+    auto plain = mix(box_stream<VectorStream>(b));
+    auto expected = measure_loudness(plain, nullptr, false);
+    auto mixed = read_all(plain);
+
+    ThreadPool pool(3);
+    for (auto p : {(ThreadPool *)nullptr, &pool}) {
+        TeeStream second(box_stream<VectorStream>(b));
+        StreamBox<float> slot = box_stream<TeeStream>(mix(second.clone()));
+        auto render = slot.clone();
+
+        auto loudness = measure_loudness(slot, p, false);
+        ASSERT_EQ(second.buffered(), 0);
+        ASSERT_EQ(slot.as<TeeStream>()->buffered(), 0);
+        ASSERT_EQ(loudness.peak, expected.peak);
+        ASSERT_NEAR(loudness.lufs, expected.lufs, 1e-3);
+
+        ASSERT_EQ(read_all(render), mixed);
+        ASSERT_EQ(read_all(second), b);
+    }
+}
+
+// without the disk cache nothing is written under $XDG_CACHE_HOME
+TEST(Loudness, DiskCacheOptOut) {
+    char dir[] = "/tmp/app_test_XXXXXX";
+    ASSERT_NE(::mkdtemp(dir), nullptr);
+    auto old = std::getenv("XDG_CACHE_HOME");
+    std::optional<std::string> saved;
+    if (old != nullptr) {
+        saved = old;
+    }
+    ::setenv("XDG_CACHE_HOME", dir, 1);
+
+    auto app = create_app();
+    auto count = [&]() {
+        size_t files = 0;
+        for (auto &entry :
+             std::filesystem::recursive_directory_iterator(dir)) {
+            files += entry.is_regular_file();
+        }
+        return files;
+    };
+
+    RenderOptions options;
+    options.disk_cache = false;
+    app.get_output_stream("gain 90%\nnormalize -20", {VOICE}, options);
+    ASSERT_EQ(count(), 0);
+
+    app.get_output_stream("gain 80%\nnormalize -20", {VOICE});
+    ASSERT_EQ(count(), 1);
+
+    if (saved.has_value()) {
+        ::setenv("XDG_CACHE_HOME", saved->c_str(), 1);
+    } else {
+        ::unsetenv("XDG_CACHE_HOME");
+    }
+    std::filesystem::remove_all(dir);
+}
+
+#ifndef APP_NO_TRACE
+// a threaded render traced like --trace does. past a second timestamps
+// still have sub-microsecond digits, every thread's events start in order
+// and each one lies inside the events that were open when it started.
+TEST(Trace, OrderedAndNested) {
+    auto app = create_app();
+    RenderOptions options;
+    options.jobs = 3;
+
+    Trace::get().start();
+    trace_thread_name("main");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    app.run_collect("mute 1 2\nresample 150%\nvocoder $2", {VOICE, VOICE},
+                    options);
+    std::stringstream out;
+    Trace::get().write(out);
+
+    std::regex pattern(R"("ts": (\d+)\.(\d{3}), "dur": (\d+)\.(\d{3}), )"
+                       R"("pid": 1, "tid": (\d+))");
+    std::map<size_t, std::vector<std::pair<uint64_t, uint64_t>>> threads;
+    std::string line;
+    while (std::getline(out, line)) {
+        if (line.find("\"ph\": \"X\"") == std::string::npos) {
+            continue;
+        }
+        std::smatch m;
+        ASSERT_TRUE(std::regex_search(line, m, pattern)) << line;
+        uint64_t start = std::stoull(m[1]) * 1000 + std::stoull(m[2]);
+        uint64_t duration = std::stoull(m[3]) * 1000 + std::stoull(m[4]);
+        ASSERT_GE(start, 1000000000) << line;
+        threads[std::stoul(m[5])].emplace_back(start, start + duration);
+    }
+    ASSERT_GT(threads.size(), 1);
+
+    for (auto &[tid, spans] : threads) {
+        std::vector<uint64_t> open;
+        uint64_t last = 0;
+        for (auto [start, end] : spans) {
+            ASSERT_GE(start, last) << tid;
+            last = start;
+            while (!open.empty() && open.back() <= start) {
+                open.pop_back();
+            }
+            if (!open.empty()) {
+                ASSERT_LE(end, open.back()) << tid << " " << start;
+            }
+            open.push_back(end);
+        }
+    }
+}
+#endif
+
+// --stats of a render where gain fuses into mute and resample reads from
+// the fused node: every node counts the samples and reads that went
+// through it, times are exclusive of the nodes read from
+TEST(Stats, CountsEveryNode) {
+    auto app = create_app();
+    auto input = open_input(VOICE);
+    size_t in_length = read_all(input).size();
+
+    RenderOptions options;
+    options.stats = std::make_shared<Stats>();
+    auto start = std::chrono::steady_clock::now();
+    auto stream = app.get_output_stream("mute 1 2\ngain 50%\nresample 150%",
+                                        {VOICE}, options);
+    std::vector<float> buffer(1000);
+    size_t length = 0, reads = 0;
+    while (auto r = stream.read(buffer)) {
+        length += *r;
+        reads++;
+    }
+    reads++;
+    auto total = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+    auto nodes = options.stats->nodes();
+    ASSERT_EQ(nodes.size(), 3);
+    ASSERT_EQ(nodes[0].label, "input $1");
+    // the fused node seeks past the muted second instead of reading it,
+    // its reads in there don't reach the input
+    ASSERT_LT(nodes[0].samples, in_length);
+    ASSERT_GE(nodes[0].samples, in_length - SAMPLE_RATE);
+    ASSERT_EQ(nodes[1].label, "mute 1 2; gain 50%");
+    ASSERT_EQ(nodes[1].samples, in_length);
+    ASSERT_LT(nodes[0].calls, nodes[1].calls);
+    ASSERT_EQ(nodes[2].label, "resample 150%");
+    ASSERT_EQ(nodes[2].samples, length);
+    ASSERT_EQ(nodes[2].calls, reads);
+
+    uint64_t sum = 0;
+    for (auto &node : nodes) {
+        // a node that subtracted more than its own time would wrap around
+        ASSERT_LE(node.wall_ns, (uint64_t)total) << node.label;
+        sum += node.wall_ns;
+    }
+    ASSERT_LE(sum, (uint64_t)total);
+
+    std::stringstream json;
+    options.stats->write_json(json, 1.5);
+    std::regex pattern(R"re(\{"label": "([^"]*)", "samples": (\d+), )re"
+                       R"re("reads": (\d+), "wall_ns": (\d+), )re"
+                       R"re("cpu_ns": \d+\})re");
+    auto text = json.str();
+    ASSERT_EQ(text.rfind("{\"seconds\": 1.5, \"nodes\": [", 0), 0) << text;
+    size_t i = 0;
+    for (std::sregex_iterator m(text.begin(), text.end(), pattern), end;
+         m != end; ++m, i++) {
+        ASSERT_LT(i, nodes.size());
+        ASSERT_EQ((*m)[1], nodes[i].label);
+        ASSERT_EQ(std::stoull((*m)[2]), nodes[i].samples);
+        ASSERT_EQ(std::stoull((*m)[3]), nodes[i].calls);
+        ASSERT_EQ(std::stoull((*m)[4]), nodes[i].wall_ns);
+    }
+    ASSERT_EQ(i, nodes.size());
+}
+
+// the optimized program renders the same samples as running every command
+// as written
+TEST(Optimize, SameOutputAsParsed) {
+    auto app = create_app();
+    std::vector<std::string> in_paths{VOICE, VOICE};
+    for (auto config : {
+             "gain 100%\nmute 1 2\ngain 100%",
+             "mute 1 3\nmute 2 4\nmute 4 5",
+             "mute 3 4\nmute 1 2\nmute 5 6\nmute 2 5",
+             "mute 1 2 fade 100\nmute 3 4 fade 200 cosine",
+             "mute 1 2 fade 500\nmute 1 3",
+             "mute 1 3 fade 100\nmute 2 4 fade 2000",
+             "mute 1 2 fade 400\nmute 3 4 fade 400",
+             "mute 1 2 fade 800\nmute 3 4 fade 800",
+             "mute 1 2 fade 100\nmute 1 2 fade 100",
+             "mute 1 4\nmute 0 100\nmute 2 3",
+             "mute 5 6\nmute 20 30 fade 100",
+             "filter lowpass 3000\nfilter highpass 200 q 1\n"
+             "filter peak 1000 6\ngain 100%\nfilter lowshelf 100 -3",
+             "resample 200%\nresample 50%",
+             "resample 100%\nresample 150%\nresample 150%",
+             "vocoder $2\nvocoder $2",
+         }) {
+        auto parsed = app.get_output_stream(app.parse(config), in_paths);
+        auto compiled = app.get_output_stream(app.compile(config), in_paths);
+        ASSERT_EQ(read_all(compiled), read_all(parsed)) << config;
+    }
+
+    ASSERT_EQ(app.compile("gain 100%\nmute 1 3\nmute 2 4\nmute 4 5").size(),
+              1);
+    ASSERT_EQ(app.compile("mute 1 2 fade 400\nmute 3 4 fade 400").size(), 1);
+    ASSERT_EQ(app.compile("mute 1 3 fade 100\nmute 2 4 fade 2000").size(), 2);
+    ASSERT_EQ(app.compile("filter lowpass 300\nfilter highpass 20").size(), 1);
+    ASSERT_EQ(app.compile("vocoder $2\nvocoder $2").size(), 2);
+}
+
 TEST(Tests, Test1) {
     auto app = create_app();
 
     auto config = "";
-    std::vector<std::string> in_paths{"../sounds/track1.wav"};
+    std::vector<std::string> in_paths{VOICE};
 
     auto data = app.run_collect(config, in_paths);
 
     auto hash = simple_hash((uint8_t *)data.data(), data.size());
-    ASSERT_EQ(hash, 1534047269);
+    ASSERT_EQ(hash, 2646378478);
 }
 
 TEST(Tests, Test2) {
     auto app = create_app();
 
-    auto config = "mix $2 10";
-    std::vector<std::string> in_paths{"../sounds/track1.wav",
-                                      "../sounds/track2.wav"};
+    auto config = "mix $2 3";
+    std::vector<std::string> in_paths{VOICE, VOICE};
 
     auto data = app.run_collect(config, in_paths);
     auto hash = simple_hash((uint8_t *)data.data(), data.size());
-    ASSERT_EQ(hash, 70551530);
+    ASSERT_EQ(hash, 2454472971);
 }
 
 TEST(Tests, Test3) {
@@ -53,24 +1280,22 @@ TEST(Tests, Test3) {
 
     auto config = "mute 1 2\n"
                   "vocoder $2";
-    std::vector<std::string> in_paths{"../sounds/voice.wav",
-                                      "../sounds/gangstaparadise.wav"};
+    std::vector<std::string> in_paths{VOICE, VOICE};
 
     auto data = app.run_collect(config, in_paths);
     auto hash = simple_hash((uint8_t *)data.data(), data.size());
-    ASSERT_EQ(hash, 3495596404);
+    ASSERT_EQ(hash, 4050529778);
 }
 
 TEST(Tests, Test4) {
     auto app = create_app();
 
     auto config = "# ...\n"
-                  "mute 10 20 # mute\n"
+                  "mute 2 4 # mute\n"
                   "resample 50%\n\n\n";
-    std::vector<std::string> in_paths{"../sounds/track2.wav",
-                                      "../sounds/track3.wav"};
+    std::vector<std::string> in_paths{VOICE, VOICE};
 
     auto data = app.run_collect(config, in_paths);
     auto hash = simple_hash((uint8_t *)data.data(), data.size());
-    ASSERT_EQ(hash, 3777795033);
+    ASSERT_EQ(hash, 347204893);
 }